@@ -141,6 +141,42 @@ struct viv_libinput_config the_libinput_configs[] = {
 };
 
 
+/// Declare any number of output configurations
+/// Whenever a new output is detected, the first output config whose name matches the
+/// output's name (e.g. "DP-1" or "HDMI-A-1") will be applied to that output.
+struct viv_output_config the_output_configs[] = {
+    // This example config can be safely deleted.
+    {
+        // This config will match the output with exactly this name.
+        .name = "DP-1",
+        // Fraction of the output's resolution to composite at before upscaling to fill the
+        // output, e.g. 0.5 to composite a 4K output at 1080p. Trades sharpness for frame
+        // time when compositing is slow, such as with the software renderer. Ignored by
+        // the scene renderer.
+        .render_scale = 1,
+        // Name of another output to mirror, or "" to display workspaces as normal. A mirror
+        // output is left out of the output layout and shows the other output's latest frame,
+        // scaled to fit, without compositing anything itself.
+        .mirror = "",
+        // Mode to use: "preferred" for the output's own choice, "highest-refresh" for the
+        // fastest refresh rate at the preferred resolution, or e.g. "2560x1440" or
+        // "2560x1440@143.9" for a specific resolution and refresh rate.
+        .mode = "preferred",
+        // Refresh rate in Hz to drop to after idle_refresh_timeout seconds with no damage
+        // and no input, going back to the configured mode on the next input or damage.
+        // 0 to never drop it.
+        .idle_refresh_rate = 0,
+        .idle_refresh_timeout = 10,
+        // Adaptive sync (VRR, e.g. FreeSync or G-Sync), which lets the output refresh when a
+        // new frame is ready rather than on a fixed clock: VIV_ADAPTIVE_SYNC_OFF,
+        // VIV_ADAPTIVE_SYNC_ON, or VIV_ADAPTIVE_SYNC_FULLSCREEN_ONLY to enable it only while
+        // a view is fullscreen, e.g. for games and video.
+        .adaptive_sync = VIV_ADAPTIVE_SYNC_OFF,
+    },
+    TERMINATE_OUTPUT_CONFIG_LIST(),
+};
+
+
 /// Declare the layouts you want to use. All workspaces have the same layouts, initially cloned from
 /// this initial config although their parameters may change independently at runtime.
 #define CONFIG_LAYOUT_PARAMETER_DEFAULT 0.666
@@ -229,7 +265,9 @@ static struct viv_config the_config = {
     // Allow views to enter fullscreen state. If allowed this bypasses the current layout.
     .allow_fullscreen = true,
 
-    // Background configuration. Applies to all outputs. Requires `swaybg` to be installed.
+    // Background configuration. Applies to all outputs. The colour replaces the clear colour,
+    // and the image is drawn by Vivarium itself, or by `swaybg` if Vivarium was built without
+    // gdk-pixbuf.
     .background = {
         .colour = "#bbbbbb",  // note: this is overridden by .image if present
         .image = "/path/to/your/background.png",
@@ -259,6 +297,9 @@ static struct viv_config the_config = {
     // Use the libinput configs list configured above.
     .libinput_configs = the_libinput_configs,
 
+    // Use the output configs list configured above.
+    .output_configs = the_output_configs,
+
     // Filename at which to write a workspace status string each time the workspace state changes.
     // This exists for basic inter-process communication e.g. with waybar, see below
     .ipc_workspaces_filename = NULL,
@@ -271,8 +312,38 @@ static struct viv_config the_config = {
                                     // can be used by the bar process as an update trigger
     },
 
+    // Render tuning. Every damage rect costs a scissored draw call for each surface it
+    // touches, so fragmented damage is merged into its bounding box when it has more than
+    // damage_max_rects rects (0 to disable), or when the bounding box would redraw at most
+    // damage_max_waste (a fraction of the box's area) more than was actually damaged.
+    .render = {
+        .damage_max_rects = 16,
+        .damage_max_waste = 0.25,
+        .max_render_time = 0,  // start rendering this many ms before vblank, 0 for immediately or -1 for automatic
+        // In the AUTO damage tracking mode, redraw the whole frame when at least this
+        // fraction of the output is damaged, or the damage has at least this many rects
+        // (0 to disable either)
+        .auto_whole_frame_area = 0.5,
+        .auto_whole_frame_rects = 64,
+        // Draw views made of several surfaces into an offscreen texture while they are
+        // unchanged, so that each damaged frame draws one texture per view instead
+        .view_texture_cache = false,
+        // AUTO to let wlroots choose a renderer, or PIXMAN to always render on the CPU. The
+        // software renderer also avoids drawing any pixel twice, e.g. clearing under borders.
+        .renderer = VIV_RENDERER_AUTO,
+        // Tiled views that the layout places entirely behind other tiled views (e.g. all but
+        // the active view in the fullscreen layout) aren't drawn, and get frame callbacks
+        // only this many times per second so that their clients draw less. 0 to send them
+        // every frame like visible views.
+        .hidden_view_frame_rate = 1,
+        // Views shown only on powered-off outputs get frame callbacks this many times per
+        // second, or never if 0
+        .powered_off_frame_rate = 1,
+    },
+
     // The damage tracking mode: NONE to fully render every frame, FRAME to render only
-    // frames with any damage, FULL to render only damaged regions of damaged frames.
+    // frames with any damage, FULL to render only damaged regions of damaged frames, AUTO
+    // to choose between FULL and FRAME for each frame depending on what looks cheaper.
     // Note: the default is currently FRAME because FULL damage tracking may still be buggy
     .damage_tracking_mode = VIV_DAMAGE_TRACKING_FRAME,
 
@@ -281,6 +352,7 @@ static struct viv_config the_config = {
     .debug_mark_active_output = false,  // draw a blue rectangle in the top left of the active output
     .debug_mark_undamaged_regions = false,  // draw only damaged regions leaving rest of output red
     .debug_mark_frame_draws = false,  // draw a small square that cycles through red/green/blue on frame draw
+    .debug_allow_direct_scanout = true,  // send fullscreen client buffers straight to the output when possible
 };
 
 
@@ -1,7 +1,17 @@
 #ifndef VIV_BACKGROUND_H
 #define VIV_BACKGROUND_H
 
-/// Fork and run swaybg with the given options
-void viv_parse_and_run_background_config(char *colour, char *image, char *mode);
+#include "viv_types.h"
+
+/// Set up the configured background. A colour replaces the clear colour, and an image is
+/// decoded in a worker thread then drawn by the renderer, or shown by running swaybg in
+/// builds without the built-in image loader.
+void viv_background_init(struct viv_server *server);
+
+/// Release the background image, waiting for it to finish loading if necessary
+void viv_background_fini(struct viv_server *server);
+
+/// Get the colour drawn wherever nothing else covers an output
+const float *viv_background_get_colour(struct viv_server *server);
 
 #endif
@@ -5,6 +5,7 @@
 
 struct viv_args {
     char *config_filen;
+    bool software_renderer;
 };
 
 struct viv_args viv_cli_parse_args(int argc, char *argv[]);
@@ -5,9 +5,11 @@
 #define TERMINATE_KEYBINDS_LIST() { .key = NULL_KEY }
 #define TERMINATE_LAYOUTS_LIST() { .name = "" }
 #define TERMINATE_LIBINPUT_CONFIG_LIST() { .device_name = "" }
+#define TERMINATE_OUTPUT_CONFIG_LIST() { .name = "" }
 
 #define MAX_NUM_KEYBINDS 10000
 #define MAX_NUM_LIBINPUT_CONFIGS 10000
+#define MAX_NUM_OUTPUT_CONFIGS 10000
 #define MAX_WORKSPACE_NAME_LENGTH 80
 #define MAX_NUM_WORKSPACES 50
 #define MAX_NUM_LAYOUTS 50
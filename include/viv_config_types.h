@@ -38,4 +38,21 @@ struct viv_libinput_config {
     double accel_speed;
 };
 
+/// When to let an output refresh at the pace of the frames drawn to it
+enum viv_adaptive_sync_mode {
+    VIV_ADAPTIVE_SYNC_OFF,
+    VIV_ADAPTIVE_SYNC_ON,
+    VIV_ADAPTIVE_SYNC_FULLSCREEN_ONLY,  // only while the output shows a fullscreen view
+};
+
+struct viv_output_config {
+    char *name;
+    float render_scale;
+    char *mirror;
+    char *mode;
+    float idle_refresh_rate;
+    float idle_refresh_timeout;
+    enum viv_adaptive_sync_mode adaptive_sync;
+};
+
 #endif
@@ -3,7 +3,13 @@
 
 #include "viv_types.h"
 
-/// Damage the given surface, which is placed at the given layout coords, on every output
-void viv_damage_surface(struct viv_server *server, struct wlr_surface *surface, int lx, int ly);
+/// Damage the given region, in layout coords, on every output it overlaps. If a view is
+/// given, the damage is dropped where that view can't be seen, either because it isn't
+/// displayed on an output or because it is covered by opaque surfaces drawn above it.
+void viv_damage_layout_region(struct viv_server *server, struct viv_view *view, pixman_region32_t *damage);
+
+/// Damage the given surface, which is placed at the given layout coords and belongs to the
+/// given view (or NULL if not part of a view), on every output where it can be seen
+void viv_damage_surface(struct viv_server *server, struct viv_view *view, struct wlr_surface *surface, int lx, int ly);
 
 #endif
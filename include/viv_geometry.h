@@ -0,0 +1,71 @@
+#ifndef VIV_GEOMETRY_H
+#define VIV_GEOMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <pixman-1/pixman.h>
+#include <wlr/util/box.h>
+
+/// How to round box edges that don't land on a whole pixel after scaling
+enum viv_geometry_rounding {
+    /// Move each edge to the nearest pixel boundary, so that adjacent boxes stay adjacent.
+    /// Use this for anything that is drawn.
+    VIV_GEOMETRY_ROUND_NEAREST,
+    /// Move each edge outwards, so that every pixel the box touches is covered. Use this
+    /// for damage, which must include anything drawn with VIV_GEOMETRY_ROUND_NEAREST.
+    VIV_GEOMETRY_ROUND_OUTWARD,
+};
+
+/// How to fit a box of one size into a box of another size
+enum viv_geometry_fit {
+    /// Scale to exactly the other size, ignoring the aspect ratio
+    VIV_GEOMETRY_FIT_STRETCH,
+    /// Scale keeping the aspect ratio until the other box is covered, overflowing it in
+    /// one direction
+    VIV_GEOMETRY_FIT_FILL,
+    /// Scale keeping the aspect ratio until the box fills the other box in one direction,
+    /// leaving bars in the other
+    VIV_GEOMETRY_FIT_FIT,
+    /// Don't scale at all
+    VIV_GEOMETRY_FIT_CENTER,
+};
+
+/// Storage reused by viv_geometry_layout_region_to_output_region between calls, so that
+/// converting a scaled region only allocates when it has more rects than ever before
+struct viv_geometry_scratch {
+    pixman_box32_t *rects;  // each rect converted, grouped into the source region's bands
+    size_t rects_capacity;
+    pixman_box32_t *bands;  // x1 and x2 are the band's range in rects, y1 and y2 its edges
+    size_t bands_capacity;
+    pixman_region32_data_t *region;  // the converted region's rects, laid out as pixman stores them
+    size_t region_capacity;
+    uint32_t allocations;  // times any of the above has grown, in total
+};
+
+/// Convert a box from layout coordinates to output coordinates, i.e. output-local pixels
+/// at the output's scale but before the output's transform. ox and oy are the offset from
+/// layout coordinates to unscaled output-local coordinates, which is minus the output's
+/// position in the layout.
+void viv_geometry_layout_box_to_output_box(struct wlr_box *output_box, const struct wlr_box *layout_box,
+                                           double ox, double oy, float scale,
+                                           enum viv_geometry_rounding rounding);
+
+/// Convert a region from layout coordinates to output coordinates, as for
+/// viv_geometry_layout_box_to_output_box. dst and src must be different regions. Nothing is
+/// allocated once scratch and dst have grown large enough, other than when switching dst
+/// between a single rect and several.
+void viv_geometry_layout_region_to_output_region(pixman_region32_t *dst, pixman_region32_t *src,
+                                                 double ox, double oy, float scale,
+                                                 enum viv_geometry_rounding rounding,
+                                                 struct viv_geometry_scratch *scratch);
+
+/// Free the storage held by a scratch, which starts out zeroed
+void viv_geometry_scratch_fini(struct viv_geometry_scratch *scratch);
+
+/// Get the box that a box of the given width and height is drawn in, when fitted centred
+/// into a box of dst_width and dst_height at the origin
+void viv_geometry_fit_box(struct wlr_box *box, int width, int height, int dst_width, int dst_height,
+                          enum viv_geometry_fit fit);
+
+#endif
@@ -50,6 +50,7 @@ union viv_mappable_payload;
     MACRO(debug_toggle_show_undamaged_regions, "Debug option to draw undamaged regions as red") \
     MACRO(debug_toggle_mark_frame_draws, "Debug option to mark frame draw events with a colour-cycling square") \
     MACRO(debug_next_damage_tracking_mode, "Switch to the next damage tracking mode (cycling back to the start if necessary)") \
+    MACRO(debug_log_render_stats, "Log statistics about the most recent frame drawn on each output") \
 
 // Declare each mappable function and generate a payload struct to pass as its argument
 MACRO_FOR_EACH_MAPPABLE(GENERATE_DECLARATION)
@@ -3,6 +3,7 @@
 
 #include <wlr/types/wlr_output_layout.h>
 
+#include "viv_geometry.h"
 #include "viv_types.h"
 
 struct viv_output *viv_output_at(struct viv_server *server, double lx, double ly);
@@ -27,14 +28,48 @@ void viv_output_do_layout_if_necessary(struct viv_output *output);
 /// Mark the whole output as damaged
 void viv_output_damage(struct viv_output *output);
 
-/// Damage the given box, expected to be unscaled and in output-layout coordinates
+/// Damage the given box, expected to be unscaled and in output-layout coordinates. The
+/// damage is scaled to cover every output pixel the box touches.
 void viv_output_damage_layout_coords_box(struct viv_output *output, struct wlr_box *box);
 
-/// Damage the given region, expected to be unscaled an in output-layout coordinates
+/// Damage the given region, expected to be unscaled and in output-layout coordinates. The
+/// damage is scaled to cover every output pixel the region touches.
 void viv_output_damage_layout_coords_region(struct viv_output *output, pixman_region32_t *damage);
 
+/// Convert the given box from output-layout coordinates to the output's scaled coordinates,
+/// rounding edges to the nearest pixel as when drawing
 void viv_output_layout_coords_box_to_output_coords(struct viv_output *output, struct wlr_box *geo_box);
 
+/// Convert the src region from output-layout coordinates to the output's scaled
+/// coordinates, storing the result in dst
+void viv_output_layout_coords_region_to_output_coords(struct viv_output *output, pixman_region32_t *dst, pixman_region32_t *src,
+                                                      enum viv_geometry_rounding rounding);
+
+/// Commit the output's pending frame, whose damage is given in output coordinates, so
+/// that any mirrors of the output only copy the parts that changed
+bool viv_output_commit(struct viv_output *output, pixman_region32_t *damage);
+
+/// Get the box, in the mirror output's coordinates, that its source output is shown in.
+/// The mirror must have a source.
+void viv_output_get_mirror_box(struct viv_output *output, struct wlr_box *box);
+
+/// Damage the mirror output where it shows the given damage to its source, in the source's
+/// output coordinates, or damage all of it if source_damage is NULL
+void viv_output_damage_mirror(struct viv_output *output, pixman_region32_t *source_damage);
+
+/// Record that the output has been powered on or off. While off, the output takes no
+/// damage, draws nothing and isn't laid out, and views paced by it get frame callbacks from
+/// a slow timer instead.
+void viv_output_set_powered(struct viv_output *output, bool powered);
+
+/// Note user input or damage, which brings the output back to its full refresh rate if it
+/// is idling at a lower one. Damage that wlroots adds by itself, such as when switching to
+/// the idle mode, doesn't go through here, so it never counts as activity.
+void viv_output_notify_activity(struct viv_output *output);
+
+/// Find the first output config whose name is the output's, or NULL if there is none
+struct viv_output_config *viv_output_find_config(struct viv_server *server, struct wlr_output *wlr_output);
+
 /// Mark that whatever workspace is active will need its layout function applying
 void viv_output_mark_for_relayout(struct viv_output *output);
 #endif
@@ -0,0 +1,55 @@
+#ifndef VIV_OUTPUT_MODE_H
+#define VIV_OUTPUT_MODE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-util.h>
+#include <wlr/types/wlr_output.h>
+
+/// The kinds of mode that an output config can ask for
+enum viv_output_mode_kind {
+    /// The mode the output itself prefers
+    VIV_OUTPUT_MODE_PREFERRED,
+    /// The highest refresh rate at the preferred mode's resolution
+    VIV_OUTPUT_MODE_HIGHEST_REFRESH,
+    /// A specific resolution, optionally with a specific refresh rate
+    VIV_OUTPUT_MODE_SIZE,
+};
+
+/// A parsed output config mode string
+struct viv_output_mode_spec {
+    enum viv_output_mode_kind kind;
+    int32_t width, height;  // only for VIV_OUTPUT_MODE_SIZE
+    int32_t refresh;  // mHz, or 0 for the highest available; only for VIV_OUTPUT_MODE_SIZE
+};
+
+/// A mode to set on an output: one of the modes it advertises, or a custom mode for
+/// backends that take any mode, such as the headless and nested backends
+struct viv_output_mode_choice {
+    struct wlr_output_mode *mode;  // NULL to use a custom mode
+    int32_t width, height;
+    int32_t refresh;  // mHz, or 0 to let the backend decide
+};
+
+/// Parse an output config mode string: "preferred", "highest-refresh", or
+/// "<width>x<height>" with an optional "@<refresh rate in Hz>". Returns false if the
+/// string isn't a mode.
+bool viv_output_mode_parse(const char *string, struct viv_output_mode_spec *spec);
+
+/// Choose the mode to set for the spec from the output's advertised modes, falling back to
+/// a custom mode for a size that isn't advertised. Returns false if there's nothing to set,
+/// i.e. the spec wants the output's own choice but it advertises no modes.
+bool viv_output_mode_choose(struct wl_list *modes, const struct viv_output_mode_spec *spec,
+                            struct viv_output_mode_choice *choice);
+
+/// Choose a mode to idle in: the one at the given size whose refresh rate is nearest to
+/// idle_refresh while still below current_refresh (both in mHz). Outputs that advertise no
+/// modes get a custom mode at idle_refresh. Returns false if there's no slower mode.
+bool viv_output_mode_choose_idle(struct wl_list *modes, int32_t width, int32_t height,
+                                 int32_t current_refresh, int32_t idle_refresh,
+                                 struct viv_output_mode_choice *choice);
+
+/// Stage the chosen mode on the output, to be applied by its next commit
+void viv_output_mode_set(struct wlr_output *wlr_output, const struct viv_output_mode_choice *choice);
+
+#endif
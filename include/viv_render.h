@@ -3,10 +3,54 @@
 
 #include "viv_types.h"
 
-void viv_render_view(struct wlr_renderer *renderer, struct viv_view *view, struct viv_output *output, pixman_region32_t *damage);
+struct viv_render_frame;
 
-void viv_render_layer_view(struct wlr_renderer *renderer, struct viv_layer_view *layer_view, struct viv_output *output);
+/// Render the given view as part of the given frame, skipping anything within the occluded
+/// region (which may be NULL)
+void viv_render_view(struct viv_render_frame *frame, struct viv_view *view, pixman_region32_t *occluded);
+
+/// Render the given layer view as part of the given frame, skipping anything within the
+/// occluded region (which may be NULL)
+void viv_render_layer_view(struct viv_render_frame *frame, struct viv_layer_view *layer_view, pixman_region32_t *occluded);
+
+/// Set the given region to the part of the output, in output coordinates, that was covered
+/// by opaque surfaces drawn above the given view in the latest frame, or to nothing if the
+/// stacking has changed since. Returns false if the view is not drawn on the output at all.
+/// Has no side effects, so it is cheap enough to call for every surface commit.
+bool viv_render_get_view_occlusion(struct viv_output *output, struct viv_view *view, pixman_region32_t *occluded);
+
+/// Mark the render entries of every output as out of date, so that they are rebuilt before
+/// next being used. Must be called whenever the set of things drawn on an output or their
+/// stacking order may have changed.
+void viv_render_invalidate_entries(struct viv_server *server);
+
+/// Call the iterator for every view and layer view that may be drawn on the output, in
+/// render order (back to front). Exactly one of view and layer_view is non-NULL in each call.
+void viv_render_for_each_entry(struct viv_output *output,
+                               void (*iterator)(struct viv_view *view, struct viv_layer_view *layer_view, void *data),
+                               void *data);
+
+/// Mark the view's texture cache as out of date, because a surface in its main surface
+/// tree has changed
+void viv_render_view_texture_cache_invalidate(struct viv_view *view);
+
+/// Release the view's texture cache, if it has one
+void viv_render_view_texture_cache_fini(struct viv_view *view);
+
+/// Send frame done events to every surface that would be drawn on the output, so that
+/// clients can start drawing their next buffers before the output is actually rendered
+void viv_render_send_frame_done(struct viv_output *output, struct timespec *when);
+
+/// Initialise the render state stored in the output, which is reused between frames
+void viv_render_output_state_init(struct viv_output *output);
+
+/// Release the render state stored in the output
+void viv_render_output_state_fini(struct viv_output *output);
 
 /// Render all surfaces on the given output, in appropriate order
 void viv_render_output(struct wlr_renderer *renderer, struct viv_output *output);
+
+/// Render the mirror output from its source output's latest buffer, without drawing any
+/// surfaces itself
+void viv_render_mirror_output(struct wlr_renderer *renderer, struct viv_output *output);
 #endif
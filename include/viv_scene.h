@@ -0,0 +1,39 @@
+#ifndef VIV_SCENE_H
+#define VIV_SCENE_H
+
+#include "viv_types.h"
+
+/// Create the scene graph used to draw every output with the wlroots scene renderer
+void viv_scene_init(struct viv_server *server);
+
+/// Add the output to the scene graph
+void viv_scene_output_init(struct viv_output *output);
+
+/// Remove the output's nodes from the scene graph, when the output is being destroyed
+void viv_scene_output_fini(struct viv_output *output);
+
+/// Add the nodes for a newly-mapped view to the scene graph. They stay hidden until the
+/// view is next found in an output's render entries.
+void viv_scene_view_map(struct viv_view *view);
+
+/// Remove the view's nodes from the scene graph, if it has any
+void viv_scene_view_unmap(struct viv_view *view);
+
+/// Add the node for a newly-mapped layer view to the scene graph
+void viv_scene_layer_view_map(struct viv_layer_view *layer_view);
+
+/// Remove the layer view's node from the scene graph, if it has one
+void viv_scene_layer_view_unmap(struct viv_layer_view *layer_view);
+
+/// Add the node for a newly-mapped popup to the scene graph, below its parent's node. The
+/// node is positioned, hidden and destroyed along with the popup by wlroots.
+void viv_scene_popup_map(struct viv_xdg_popup *popup);
+
+/// Stop tracking the popup's node, because the popup is being destroyed
+void viv_scene_popup_destroy(struct viv_xdg_popup *popup);
+
+/// Bring the scene graph up to date with the current views and layer views, then draw
+/// the output from it
+void viv_scene_render_output(struct viv_output *output);
+
+#endif
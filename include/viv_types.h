@@ -1,6 +1,8 @@
 #ifndef VIV_TYPES_H
 #define VIV_TYPES_H
 
+#include <pixman-1/pixman.h>
+#include <pthread.h>
 #include <wayland-server-core.h>
 #include <wlr/util/box.h>
 #include <wlr/types/wlr_output_management_v1.h>
@@ -11,19 +13,58 @@
 #include <xkbcommon/xkbcommon.h>
 
 #include "viv_config_support.h"
+#include "viv_geometry.h"
+#include "viv_output_mode.h"
 
 #ifdef XWAYLAND
 #include <wlr/xwayland.h>
 #include "viv_xwayland_types.h"
 #endif
 
+#ifdef SCENE_RENDERER
+#include <wlr/types/wlr_scene.h>
+
+/// Bands of the scene graph, from bottom to top. Every output's nodes are stacked in the
+/// same bands, which keeps the stacking right because only floating views span outputs.
+enum viv_scene_layer {
+    VIV_SCENE_LAYER_CLEAR,  // filled with the clear colour
+    VIV_SCENE_LAYER_BACKGROUND,
+    VIV_SCENE_LAYER_BOTTOM,
+    VIV_SCENE_LAYER_TILED,
+    VIV_SCENE_LAYER_FLOATING,
+    VIV_SCENE_LAYER_FULLSCREEN,  // fullscreen views, each above a black fill of its output
+    VIV_SCENE_LAYER_TOP,
+    VIV_SCENE_LAYER_OVERLAY,
+    VIV_SCENE_LAYER_MAX,
+};
+#endif
+
 enum viv_damage_tracking_mode {
     VIV_DAMAGE_TRACKING_NONE,  // every frame is fully re-rendered
     VIV_DAMAGE_TRACKING_FRAME,   // any damage triggers a full frame render
     VIV_DAMAGE_TRACKING_FULL,  // only damaged regions are rendered
+    VIV_DAMAGE_TRACKING_AUTO,  // each frame is rendered as in FULL or FRAME mode, whichever looks cheaper
     VIV_DAMAGE_TRACKING_MAX,
 };
 
+enum viv_renderer_type {
+    VIV_RENDERER_AUTO,  // let wlroots choose, usually a GPU renderer if one is available
+    VIV_RENDERER_PIXMAN,  // always render on the CPU, e.g. on hosts without a GPU
+    VIV_RENDERER_MAX,
+};
+
+/// How the background image is fitted to each output, as for swaybg's modes
+enum viv_background_mode {
+    VIV_BACKGROUND_MODE_STRETCH,
+    VIV_BACKGROUND_MODE_FILL,
+    VIV_BACKGROUND_MODE_FIT,
+    VIV_BACKGROUND_MODE_CENTER,
+    VIV_BACKGROUND_MODE_TILE,
+    VIV_BACKGROUND_MODE_SOLID_COLOUR,  // ignore the image and only draw the colour
+};
+
+struct viv_background_image;
+
 enum viv_cursor_mode {
 	VIV_CURSOR_PASSTHROUGH,  /// Pass through cursor data to views
 	VIV_CURSOR_MOVE,  /// A view is being moved
@@ -41,13 +82,17 @@ struct viv_view;
 
 struct viv_server {
     char *user_provided_config_filen;
+    bool user_requested_software_renderer;  // overrides the configured renderer
     struct viv_config *config;
 
 	struct wl_display *wl_display;
 	struct wlr_backend *backend;
 	struct wlr_renderer *renderer;
+    bool software_renderer;  // the renderer draws on the CPU, whether configured or chosen by wlroots
     struct wlr_allocator *allocator;
     struct wlr_compositor *compositor;
+    struct wlr_presentation *presentation;
+    struct wlr_viewporter *viewporter;
 
 	struct wlr_xdg_shell *xdg_shell;
 	struct wl_listener new_xdg_surface;
@@ -91,6 +136,7 @@ struct viv_server {
 	struct wlr_output_layout *output_layout;
     struct viv_output *active_output;
 	struct wl_list outputs;
+    struct wl_list mirror_outputs;  // outputs mirroring another, which are kept out of the layout
 	struct wl_listener new_output;
 
     struct wlr_output_power_manager_v1 *output_power_manager;
@@ -109,6 +155,33 @@ struct viv_server {
     /// Unmapped views are not kept within the workspace view lists,
     /// in order to keep things simple when iterating through them
     struct wl_list unmapped_views;
+
+    /// Incremented whenever any popup's geometry changes, invalidating the cached popup
+    /// offsets (which depend on the geometry of every parent popup)
+    uint32_t popup_geometry_generation;
+
+    /// Incremented whenever the stacking of views or layer views changes, invalidating
+    /// every output's render entries
+    uint32_t render_entries_generation;
+
+    /// The built-in background, drawn wherever nothing else covers an output
+    struct {
+        bool has_colour;  // whether colour replaces the config's clear colour
+        float colour[4];  // premultiplied RGBA
+        enum viv_background_mode mode;
+        struct wlr_texture *texture;  // the decoded image, NULL until it has loaded
+        uint32_t generation;  // incremented whenever the texture changes
+        struct viv_background_image *loading;  // the image being decoded, if any
+        pthread_t loading_thread;
+        struct wl_event_source *loaded_source;
+    } background;
+
+#ifdef SCENE_RENDERER
+    /// Scene graph mirroring everything that is drawn, for the wlroots scene renderer
+    struct wlr_scene *scene;
+    struct wlr_scene_tree *scene_layers[VIV_SCENE_LAYER_MAX];
+    uint32_t scene_sync_generation;  // incremented every time the scene graph is updated
+#endif
 };
 
 struct viv_keybindings {
@@ -118,6 +191,47 @@ struct viv_keybindings {
 
 struct viv_workspace;
 
+/// Statistics about the most recent frame drawn on an output, used to check that render
+/// optimisations are actually taking effect
+struct viv_render_stats {
+    uint32_t culled_surfaces;  // surfaces skipped because they were hidden beneath opaque surfaces
+    uint32_t hidden_views;  // tiled views skipped because opaque content above covered them entirely
+    bool scanout_active;  // the fullscreen view's buffer was displayed directly, without compositing
+    uint32_t scanout_frames;  // frames displayed by direct scanout, in total
+    uint32_t scanout_switches;  // changes between direct scanout and compositing, in total
+    uint32_t allocations;  // heap allocations of render state made during the frame, zero in the steady state
+    uint32_t damage_rects_before;  // rects in the frame's damage as reported by wlroots
+    uint32_t damage_rects_after;  // rects in the frame's damage after coalescing
+    int render_delay_msec;  // time waited after the frame event before rendering
+    uint32_t missed_deadlines;  // delayed renders that finished after the predicted vblank, in total
+    bool whole_frame;  // the whole output was redrawn, rather than only its damaged regions
+    uint32_t damage_mode_switches;  // changes between partial and whole frames in auto damage tracking mode, in total
+    uint32_t frames_rendered;  // calls to the renderer, in total
+    int64_t total_render_nsec;  // time spent in the renderer, in total
+    int64_t max_render_nsec;  // longest time spent rendering a single frame
+    int64_t total_render_cpu_nsec;  // CPU time used by the renderer, in total
+};
+
+/// Regions reused by every frame drawn on an output, so that their storage is only
+/// allocated when they grow. Must contain only regions, as it is iterated as an array.
+struct viv_render_scratch {
+    pixman_region32_t damage;
+    pixman_region32_t frame_damage;
+    pixman_region32_t clear;
+    pixman_region32_t total_opaque;
+    pixman_region32_t opaque_union;
+    pixman_region32_t surface_opaque;
+    pixman_region32_t surface_opaque_spare;
+    pixman_region32_t surface_bounds;
+    pixman_region32_t surface_damage;
+    pixman_region32_t surface_damage_spare;
+    pixman_region32_t visible_damage;
+    pixman_region32_t border;
+    pixman_region32_t rect_damage;
+    pixman_region32_t opaque_fills;
+    pixman_region32_t view_covered;
+};
+
 struct viv_output {
 	struct wl_list link;
 	struct viv_server *server;
@@ -132,11 +246,90 @@ struct viv_output {
 
     struct wlr_output_damage *damage;
 
+    struct viv_output_config *config;  // the config matching the output's name, or NULL if none does
+
     bool needs_layout;
     struct viv_workspace *current_workspace;
 
     uint32_t frame_draw_count;  // only used by debug options
 
+    struct viv_render_stats render_stats;
+    struct wl_array render_entries;  // everything drawn on the output, in render order
+    uint32_t render_entries_generation;  // server render_entries_generation when last built
+    bool render_entries_occlusion_valid;  // each entry's occluded region is from the latest frame
+    struct viv_render_scratch render_scratch;
+    struct viv_geometry_scratch geometry_scratch;  // for converting regions to output coordinates
+
+    /// State for delaying rendering until shortly before the next vblank
+    struct {
+        struct wl_event_source *timer;
+        int64_t last_presentation_nsec;  // time of the most recent vblank, from the present event
+        int refresh_nsec;  // refresh period reported by the present event, 0 if unknown
+        int64_t predicted_vblank_nsec;  // the vblank that the delayed render is aiming for
+        int64_t render_time_estimate_nsec;  // slowly-decaying maximum of recent render times
+        bool frame_done_sent;  // clients have already been sent frame done for this frame
+        bool deferred;  // a render is waiting for the timer, which frame events leave alone
+    } render_schedule;
+
+    /// Whether the output has been powered off through the power manager, in which case it
+    /// takes no damage and draws nothing until powered on again
+    bool powered_off;
+    struct wl_event_source *powered_off_timer;  // sends frame callbacks while powered off
+
+    /// State for dropping to a slower refresh rate while nothing changes on the output
+    struct {
+        int32_t refresh;  // mHz to idle at, or 0 if the output never idles
+        int timeout_msec;
+        struct wl_event_source *timer;
+        int64_t last_activity_msec;  // time of the most recent damage or input
+        bool downclocked;  // the output is currently in its idle mode
+        bool activity_pending;  // input or damage has arrived since the output was downclocked
+        struct viv_output_mode_choice restore_mode;  // the mode to go back to after idling
+    } idle_refresh;
+
+    bool adaptive_sync_requested;  // adaptive sync was last asked for, even if the output refused
+
+    /// State for choosing whether to redraw whole frames in the auto damage tracking mode
+    struct {
+        bool whole_frame;  // the most recent frame was redrawn whole
+        int64_t partial_render_nsec;  // moving average of partial frame render times, 0 if unknown
+        int64_t whole_render_nsec;  // moving average of whole frame render times, 0 if unknown
+        uint32_t frames_since_partial;  // whole frames drawn since the last partial frame
+    } damage_governor;
+
+    /// Buffer that the output is composited into when its render scale is below 1, before
+    /// being scaled up to fill the output
+    struct {
+        float scale;  // fraction of the output's resolution to composite at
+        struct wlr_buffer *buffer;
+        struct wlr_texture *texture;  // made from the buffer each time it is drawn
+    } reduced_render;
+
+    /// State for mirroring, both as a mirror output and as the source of other mirrors
+    struct {
+        bool is_mirror;  // shows another output's frames, rather than a workspace
+        struct viv_output *source;  // the output being mirrored, NULL until it exists
+        struct wlr_buffer *buffer;  // the latest committed buffer, kept while being mirrored
+        struct wlr_texture *texture;  // made from the buffer when a mirror first draws it
+        pixman_region32_t frame_damage;  // what changed in the frame being committed
+        bool has_frame_damage;  // false when a commit's changes aren't known
+        struct wl_listener commit;
+    } mirror;
+
+    /// The background drawn once at the render resolution, so that each frame only copies
+    /// it rather than scaling the image again
+    struct {
+        struct wlr_buffer *buffer;
+        struct wlr_texture *texture;
+        uint32_t generation;  // the server's background generation that was drawn
+    } background_cache;
+
+#ifdef SCENE_RENDERER
+    struct wlr_scene_output *scene_output;
+    struct wlr_scene_rect *scene_background;  // filled with the clear colour, below everything else
+    struct wlr_scene_rect *scene_fullscreen_fill;  // black fill just below any fullscreen view
+#endif
+
     struct wl_list layer_views;
     struct {
         uint32_t left;
@@ -176,6 +369,11 @@ struct viv_layer_view {
     struct wl_list output_link;
 
     int x, y;
+
+#ifdef SCENE_RENDERER
+    struct wlr_scene_node *scene_node;  // only while mapped
+    uint32_t scene_sync_generation;  // server scene_sync_generation when last drawn
+#endif
 };
 
 enum viv_view_type {
@@ -204,12 +402,24 @@ struct viv_xdg_popup {
     struct wlr_xdg_popup *wlr_popup;
     struct viv_xdg_popup *parent_popup;
     struct viv_server *server;
+    struct viv_view *view;  // the view the popup belongs to, or NULL for layer view popups
 
     struct viv_surface_tree_node *surface_tree;
 
     int *lx;  // pointer to x of parent view/layer-view in layout coords
     int *ly;  // pointer to y of parent view/layer-view in layout coords
 
+    int offset_x;  // cached offset from lx/ly, summed over the popup and its parents
+    int offset_y;
+    uint32_t cached_offset_generation;  // server popup_geometry_generation when cached
+    struct wlr_box last_geometry;  // popup geometry when last checked for changes
+
+#ifdef SCENE_RENDERER
+    struct wlr_scene_node *scene_node;
+    struct wlr_scene_node **parent_scene_node;  // pointer to the scene node of the popup's parent
+    struct wl_listener scene_node_destroy;
+#endif
+
     struct wl_listener surface_commit;
     struct wl_listener surface_map;
     struct wl_listener surface_unmap;
@@ -262,6 +472,35 @@ struct viv_view {
     struct wlr_box target_box;
     struct wlr_box target_box_before_fullscreen;
 
+    pixman_region32_t border_region;  // cached from viv_view_get_border_region, in layout coords
+    struct wlr_box border_region_box;  // the target box for which border_region was computed
+    bool border_region_valid;
+
+    /// Offscreen copy of the view's main surface tree (without popups), so that the whole
+    /// tree can be drawn as one texture while none of its surfaces change
+    struct {
+        struct wlr_buffer *buffer;
+        struct wlr_texture *texture;
+        struct wlr_box bounds;  // the part of the tree covered by the buffer, in surface-local coords
+        float scale;  // the output scale that the buffer was drawn at
+        bool dirty;  // a surface in the tree has committed since the buffer was drawn
+        bool committed_since_update;  // a surface in the tree has committed since the last update attempt
+    } texture_cache;
+
+    /// When the view last got frame callbacks while hidden behind other views, in msec on
+    /// the monotonic clock
+    int64_t hidden_frame_done_msec;
+
+#ifdef SCENE_RENDERER
+    /// The view's nodes in the scene graph, which exist only while the view is mapped
+    struct {
+        struct wlr_scene_tree *tree;  // positioned at the view's x and y, only while mapped
+        struct wlr_scene_node *surface;  // the view's surfaces, within the tree
+        struct wlr_scene_rect *borders[4];
+        uint32_t sync_generation;  // server scene_sync_generation when last drawn
+    } scene;
+#endif
+
     bool is_floating;
     float floating_width, floating_height;  /// width and height to be used if the view becomes floating
 
@@ -329,6 +568,18 @@ struct viv_config {
         uint32_t update_signal_number;
     } bar;
 
+    struct {
+        uint32_t damage_max_rects;
+        double damage_max_waste;
+        int max_render_time;
+        double auto_whole_frame_area;
+        uint32_t auto_whole_frame_rects;
+        bool view_texture_cache;
+        enum viv_renderer_type renderer;
+        double hidden_view_frame_rate;
+        double powered_off_frame_rate;
+    } render;
+
     struct {
         char *rules;
         char *model;
@@ -343,12 +594,15 @@ struct viv_config {
 
     struct viv_libinput_config *libinput_configs;
 
+    struct viv_output_config *output_configs;
+
     enum viv_damage_tracking_mode damage_tracking_mode;
 
     bool debug_mark_views_by_shell;
     bool debug_mark_active_output;
     bool debug_mark_frame_draws;
     bool debug_mark_undamaged_regions;
+    bool debug_allow_direct_scanout;
 };
 
 struct viv_seat {
@@ -5,7 +5,8 @@
 
 #include "viv_types.h"
 
-/// Bring the given view to the front of its workspace view list
+/// Bring the given view to the front of its workspace view list, so that it is drawn above
+/// the workspace's other views
 void viv_view_bring_to_front(struct viv_view *view);
 
 /// Clear focus from all views handled by the server;
@@ -43,9 +44,32 @@ void viv_view_get_string_identifier(struct viv_view *view, char *buffer, size_t
 /// True if the surface geometry size exceeds that of the target draw region, else false
 bool viv_view_oversized(struct viv_view *view);
 
-/// Mark the view as damaged on every output
+/// True if the view may be drawn on the given output, i.e. its workspace is displayed there
+/// (or elsewhere, for floating views) and it isn't hidden behind a fullscreen view
+bool viv_view_is_visible_on_output(struct viv_view *view, struct viv_output *output);
+
+/// Get the output whose frames pace the view's client, i.e. the enabled output where the
+/// most of the view is visible, or its workspace's output if it isn't visible on any. Only
+/// this output sends the client frame callbacks and presentation feedback, so that a view
+/// spanning outputs with different refresh rates draws at one of them, not their sum.
+struct viv_output *viv_view_get_primary_output(struct viv_view *view);
+
+/// Mark the view as damaged on every output where it may be visible
 void viv_view_damage(struct viv_view *view);
 
+/// True if a border should be drawn around the view
+bool viv_view_draws_borders(struct viv_view *view);
+
+/// True if the view should be drawn with the active border colour on the given output
+bool viv_view_is_active_on_output(struct viv_view *view, struct viv_output *output);
+
+/// Get the region covered by the view's border, in layout coordinates. The region is
+/// cached and only recomputed when the view's target box changes.
+pixman_region32_t *viv_view_get_border_region(struct viv_view *view);
+
+/// Mark only the view's border as damaged, e.g. when it needs drawing in a different colour
+void viv_view_damage_borders(struct viv_view *view);
+
 /// Set the size of a view
 void viv_view_set_size(struct viv_view *view, uint32_t width, uint32_t height);
 
@@ -11,6 +11,7 @@ struct viv_surface_tree_node {
     struct wl_listener commit;
     struct wl_listener destroy;
 
+    struct viv_surface_tree_node *root;
     struct viv_surface_tree_node *parent;
     struct viv_wlr_subsurface *subsurface;
 
@@ -18,6 +19,18 @@ struct viv_surface_tree_node {
 
     void (*apply_global_offset)(void *, int *, int *);
     void *global_offset_data;
+
+    struct viv_view *view;  // the view owning the tree, or NULL if it isn't part of a view
+
+    // Offset of this surface from the root's global offset, cached to avoid walking the
+    // tree on every commit. Valid while cached_offset_generation matches the root's
+    // offset_generation, which is incremented whenever any surface in the tree moves.
+    int root_offset_x;
+    int root_offset_y;
+    uint32_t cached_offset_generation;
+    uint32_t offset_generation;  // only used by the root node
+    int last_sx;  // surface offset when last checked for movement
+    int last_sy;
 };
 
 struct viv_wlr_subsurface {
@@ -26,6 +39,9 @@ struct viv_wlr_subsurface {
     struct viv_surface_tree_node *parent;
     struct viv_surface_tree_node *child;
 
+    int32_t last_x;  // subsurface position when last checked for movement
+    int32_t last_y;
+
     struct wl_list node_link;
 
     struct wl_listener map;
@@ -36,9 +52,9 @@ struct viv_wlr_subsurface {
 
 // Create a surface tree from the input surface. The surface tree will automatically wrap
 // all of the subsurfaces (existing or later-created) and handle all surface commit
-// events.  Commit events will be used to damage every output, with offsets calculated
-// including the global offset passed here.
-struct viv_surface_tree_node *viv_surface_tree_root_create(struct viv_server *server, struct wlr_surface *surface, void (*apply_global_offset)(void *, int *, int *), void *global_offset_data);
+// events.  Commit events will be used to damage every output where the given view (if
+// any) can be seen, with offsets calculated including the global offset passed here.
+struct viv_surface_tree_node *viv_surface_tree_root_create(struct viv_server *server, struct wlr_surface *surface, void (*apply_global_offset)(void *, int *, int *), void *global_offset_data, struct viv_view *view);
 
 /// Clean up the node's state (bound events etc.) and free it
 void viv_surface_tree_destroy(struct viv_surface_tree_node *node);
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Build Vivarium with each renderer and run the same headless workload on both, once on
+# the GPU and once with the pixman software renderer, printing the render timings and CPU
+# time per frame of each. The output is 1920x1080. The workload can be changed with the VIV_BENCHMARK_CLIENT,
+# VIV_BENCHMARK_CLIENTS and VIV_BENCHMARK_SECONDS environment variables.
+set -e
+
+cd "$(dirname "$0")/.."
+
+export XDG_RUNTIME_DIR="${XDG_RUNTIME_DIR:-/tmp/vivarium-benchmark}"
+mkdir -p "$XDG_RUNTIME_DIR"
+
+for renderer in custom scene; do
+    build_dir="build_benchmark_$renderer"
+    meson setup --reconfigure "$build_dir" -Ddebug=false -Dheadless-benchmark=true -Drenderer="$renderer" > /dev/null
+    ninja -C "$build_dir" > /dev/null
+    "./$build_dir/src/vivarium" 2> "$build_dir/benchmark.log" | grep '^benchmark:'
+    "./$build_dir/src/vivarium" --software-renderer 2> "$build_dir/benchmark_pixman.log" | grep '^benchmark:'
+done
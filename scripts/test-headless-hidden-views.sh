@@ -0,0 +1,46 @@
+#!/bin/sh
+# Stack two clients in the fullscreen layout on a headless output and check which of them
+# are skipped as hidden: none when the client on top is translucent, as the one underneath
+# shows through it, and the one underneath when the client on top is opaque. The clients
+# can be changed with the VIV_TRANSLUCENT_CLIENT and VIV_OPAQUE_CLIENT environment
+# variables, and must keep drawing buffers that fill whatever size they are given.
+set -e
+
+cd "$(dirname "$0")/.."
+
+export XDG_RUNTIME_DIR="${XDG_RUNTIME_DIR:-/tmp/vivarium-benchmark}"
+mkdir -p "$XDG_RUNTIME_DIR"
+
+export VIV_BENCHMARK_CLIENTS=2
+export VIV_BENCHMARK_SECONDS="${VIV_BENCHMARK_SECONDS:-5}"
+translucent_client="${VIV_TRANSLUCENT_CLIENT:-weston-simple-egl}"
+opaque_client="${VIV_OPAQUE_CLIENT:-weston-simple-egl -o}"
+
+build_dir="build_test_hidden_views"
+meson setup --reconfigure "$build_dir" -Ddebug=true -Dheadless-benchmark=true -Drenderer=custom > /dev/null
+ninja -C "$build_dir" > /dev/null
+
+# The default config, but with the fullscreen layout first so that the clients are stacked
+config="$build_dir/hidden_views.toml"
+awk 'BEGIN { RS = ""; ORS = "\n\n" } !/name = "Tall"/' config/config.toml > "$config"
+
+# Run the clients and print how many views were hidden on the last frame
+run_clients() {
+    result=$(VIV_BENCHMARK_CLIENT="$1" "./$build_dir/src/vivarium" --config "$config" 2> "$build_dir/$2.log" |
+                 grep '^benchmark:')
+    echo "$result" >&2
+    echo "$result" | sed -n 's/.*hidden_views=\([0-9]*\).*/\1/p'
+}
+
+hidden_views=$(run_clients "$translucent_client" translucent)
+if [ "$hidden_views" != 0 ]; then
+    echo "FAIL: $hidden_views views hidden beneath a translucent client, see $build_dir/translucent.log"
+    exit 1
+fi
+
+hidden_views=$(run_clients "$opaque_client" opaque)
+if [ "$hidden_views" != 1 ]; then
+    echo "FAIL: $hidden_views views hidden beneath an opaque client rather than 1, see $build_dir/opaque.log"
+    exit 1
+fi
+echo "PASS: nothing hidden beneath a translucent client, and the view beneath an opaque client hidden"
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Let a headless output go idle with an idle-refresh-rate configured, and check that it drops
+# to the idle rate once and stays there while nothing draws, rather than flapping back to the
+# full rate on the damage from its own mode switch. Then start a client after the output has
+# gone idle and check that its damage restores the full rate. The client can be changed with
+# the VIV_IDLE_REFRESH_CLIENT environment variable, and must keep drawing until killed.
+set -e
+
+cd "$(dirname "$0")/.."
+
+export XDG_RUNTIME_DIR="${XDG_RUNTIME_DIR:-/tmp/vivarium-benchmark}"
+mkdir -p "$XDG_RUNTIME_DIR"
+
+export VIV_BENCHMARK_CLIENTS=1
+export VIV_BENCHMARK_SECONDS=4
+client="${VIV_IDLE_REFRESH_CLIENT:-weston-simple-shm}"
+
+build_dir="build_test_idle_refresh"
+meson setup --reconfigure "$build_dir" -Ddebug=true -Dheadless-benchmark=true -Drenderer=custom > /dev/null
+ninja -C "$build_dir" > /dev/null
+
+# The default config, but with the example output-config applied to the headless output and
+# dropping it to 30 Hz after half a second of idleness
+config="$build_dir/idle_refresh.toml"
+sed -e 's/^name = "DP-1"$/name = "HEADLESS-1"/' \
+    -e 's/^idle-refresh-rate = .*/idle-refresh-rate = 30.0/' \
+    -e 's/^idle-refresh-timeout = .*/idle-refresh-timeout = 0.5/' \
+    config/config.toml > "$config"
+
+# Run the client command and print the output's refresh rate at the end, in mHz
+run_client() {
+    result=$(VIV_BENCHMARK_CLIENT="$1" "./$build_dir/src/vivarium" --config "$config" 2> "$build_dir/$2.log" |
+                 grep '^benchmark:')
+    echo "$result" >&2
+    echo "$result" | sed -n 's/.*refresh_mhz=\([0-9]*\).*/\1/p'
+}
+
+count_log() {
+    grep -c "$1" "$build_dir/$2.log" || true
+}
+
+# No client damage at all: the output should go idle once and hold the idle rate
+refresh_mhz=$(run_client "exec sleep 3600" quiet)
+lowered=$(count_log "idle, refresh rate lowered" quiet)
+restored=$(count_log "active, refresh rate restored" quiet)
+if [ "$lowered" != 1 ] || [ "$restored" != 0 ] || [ "$refresh_mhz" != 30000 ]; then
+    echo "FAIL: refresh rate lowered $lowered times and restored $restored times without damage," \
+         "ending at $refresh_mhz mHz rather than 30000, see $build_dir/quiet.log"
+    exit 1
+fi
+
+# A client that starts drawing after the output has gone idle should restore the full rate
+refresh_mhz=$(run_client "sleep 2 && exec $client" damaged)
+lowered=$(count_log "idle, refresh rate lowered" damaged)
+restored=$(count_log "active, refresh rate restored" damaged)
+if [ "$lowered" != 1 ] || [ "$restored" != 1 ] || [ "$refresh_mhz" = 30000 ]; then
+    echo "FAIL: refresh rate lowered $lowered times and restored $restored times around a client" \
+         "drawing, ending at $refresh_mhz mHz, see $build_dir/damaged.log"
+    exit 1
+fi
+echo "PASS: idle refresh rate held without damage, and the full rate restored by client damage"
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Run a fullscreen client on a headless output and check that its buffers are scanned out
+# directly: at least one frame must be scanned out, and scanout must not flap between
+# scanning out and compositing while the client stays fullscreen. The client can be changed
+# with the VIV_BENCHMARK_CLIENT environment variable, and must request fullscreen and draw
+# buffers that cover the whole 1920x1080 output.
+set -e
+
+cd "$(dirname "$0")/.."
+
+export XDG_RUNTIME_DIR="${XDG_RUNTIME_DIR:-/tmp/vivarium-benchmark}"
+mkdir -p "$XDG_RUNTIME_DIR"
+
+export VIV_BENCHMARK_CLIENT="${VIV_BENCHMARK_CLIENT:-weston-simple-egl -f}"
+export VIV_BENCHMARK_CLIENTS=1
+export VIV_BENCHMARK_SECONDS="${VIV_BENCHMARK_SECONDS:-5}"
+
+build_dir="build_test_scanout"
+meson setup --reconfigure "$build_dir" -Ddebug=true -Dheadless-benchmark=true -Drenderer=custom > /dev/null
+ninja -C "$build_dir" > /dev/null
+
+result=$("./$build_dir/src/vivarium" 2> "$build_dir/scanout.log" | grep '^benchmark:')
+echo "$result"
+
+scanout_frames=$(echo "$result" | sed -n 's/.*scanout_frames=\([0-9]*\).*/\1/p')
+scanout_switches=$(echo "$result" | sed -n 's/.*scanout_switches=\([0-9]*\).*/\1/p')
+
+if [ -z "$scanout_frames" ] || [ "$scanout_frames" -eq 0 ]; then
+    echo "FAIL: no frames were scanned out, see $build_dir/scanout.log"
+    exit 1
+fi
+# Scanout starts once when the client goes fullscreen, and the stats are printed before the
+# client is stopped
+if [ "$scanout_switches" -gt 1 ]; then
+    echo "FAIL: scanout switched $scanout_switches times, see $build_dir/scanout.log"
+    exit 1
+fi
+echo "PASS: $scanout_frames frames scanned out with $scanout_switches switches"
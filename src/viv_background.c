@@ -1,5 +1,10 @@
+#include <drm_fourcc.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,8 +15,47 @@
 #include <sys/wait.h>
 #include <unistd.h>
 #include <wordexp.h>
+#include <wayland-server-core.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
 #include <wlr/util/log.h>
 
+#ifdef BACKGROUND_IMAGE
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#endif
+
+#include "viv_background.h"
+#include "viv_config_support.h"
+#include "viv_output.h"
+#include "viv_types.h"
+
+/// An image being decoded by the worker thread. The main thread must not touch it until
+/// the worker has written to done_fd.
+struct viv_background_image {
+    char *path;
+    int width;
+    int height;
+    int stride;
+    uint8_t *pixels;  // premultiplied RGBA bytes, or NULL if the image could not be decoded
+    char *error;  // why the image could not be decoded, for the main thread to log
+    int done_fd;  // written to by the worker when it has finished
+    int done_read_fd;
+};
+
+struct background_mode_name {
+    char *name;
+    enum viv_background_mode mode;
+};
+
+static struct background_mode_name background_mode_names[] = {
+    {"stretch", VIV_BACKGROUND_MODE_STRETCH},
+    {"fill", VIV_BACKGROUND_MODE_FILL},
+    {"fit", VIV_BACKGROUND_MODE_FIT},
+    {"center", VIV_BACKGROUND_MODE_CENTER},
+    {"tile", VIV_BACKGROUND_MODE_TILE},
+    {"solid_color", VIV_BACKGROUND_MODE_SOLID_COLOUR},
+};
+
 static void run_swaybg(char *colour, char *image, char *mode) {
 	pid_t pid = fork();
 	if (pid == 0) {
@@ -32,15 +76,240 @@ static void run_swaybg(char *colour, char *image, char *mode) {
     }
 }
 
-void viv_parse_and_run_background_config(char *colour, char *image, char *mode) {
+/// Parse a colour in swaybg's format, i.e. "#RRGGBB" or "#RRGGBBAA" with the "#" optional,
+/// into premultiplied RGBA. Returns false if the string isn't a colour.
+static bool parse_colour(const char *string, float colour[static 4]) {
+    if (string[0] == '#') {
+        string++;
+    }
+    size_t length = strlen(string);
+    if ((length != 6) && (length != 8)) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (!strchr("0123456789abcdefABCDEF", string[i])) {
+            return false;
+        }
+    }
+
+    uint32_t value = strtoul(string, NULL, 16);
+    if (length == 6) {
+        value = (value << 8) | 0xff;
+    }
+    colour[3] = (value & 0xff) / 255.0f;
+    for (size_t i = 0; i < 3; i++) {
+        colour[i] = ((value >> (24 - 8 * i)) & 0xff) / 255.0f * colour[3];
+    }
+    return true;
+}
+
+static bool parse_mode(const char *string, enum viv_background_mode *mode) {
+    for (size_t i = 0; i < sizeof(background_mode_names) / sizeof(background_mode_names[0]); i++) {
+        if (strcmp(string, background_mode_names[i].name) == 0) {
+            *mode = background_mode_names[i].mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef BACKGROUND_IMAGE
+/// Copy the pixbuf's pixels into the image as premultiplied RGBA, which is what every
+/// renderer expects from DRM_FORMAT_ABGR8888 on little-endian machines
+static void copy_pixbuf_pixels(struct viv_background_image *image, GdkPixbuf *pixbuf) {
+    int channels = gdk_pixbuf_get_n_channels(pixbuf);
+    bool has_alpha = gdk_pixbuf_get_has_alpha(pixbuf);
+    int pixbuf_stride = gdk_pixbuf_get_rowstride(pixbuf);
+    const guint8 *pixbuf_pixels = gdk_pixbuf_read_pixels(pixbuf);
+
+    image->width = gdk_pixbuf_get_width(pixbuf);
+    image->height = gdk_pixbuf_get_height(pixbuf);
+    image->stride = image->width * 4;
+    image->pixels = calloc((size_t)image->stride * image->height, 1);
+    CHECK_ALLOCATION(image->pixels);
+
+    for (int y = 0; y < image->height; y++) {
+        const guint8 *src = pixbuf_pixels + (size_t)y * pixbuf_stride;
+        uint8_t *dst = image->pixels + (size_t)y * image->stride;
+        for (int x = 0; x < image->width; x++) {
+            uint8_t alpha = has_alpha ? src[3] : 0xff;
+            dst[0] = src[0] * alpha / 0xff;
+            dst[1] = src[1] * alpha / 0xff;
+            dst[2] = src[2] * alpha / 0xff;
+            dst[3] = alpha;
+            src += channels;
+            dst += 4;
+        }
+    }
+}
+
+/// Worker thread: decode the image file, so that large images don't stall the compositor.
+/// It leaves all logging to the main thread.
+static void *decode_image(void *data) {
+    struct viv_background_image *image = data;
+
+    GError *error = NULL;
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file(image->path, &error);
+    if (pixbuf) {
+        copy_pixbuf_pixels(image, pixbuf);
+        g_object_unref(pixbuf);
+    } else {
+        image->error = strdup(error->message);
+        CHECK_ALLOCATION(image->error);
+        g_error_free(error);
+    }
+
+    // The pipe always has room for a byte, so writing can only be interrupted
+    uint8_t done = 1;
+    while ((write(image->done_fd, &done, sizeof(done)) != sizeof(done)) && (errno == EINTR)) {
+    }
+    return NULL;
+}
+
+static void free_image(struct viv_background_image *image) {
+    close(image->done_fd);
+    close(image->done_read_fd);
+    free(image->path);
+    free(image->pixels);
+    free(image->error);
+    free(image);
+}
+
+/// Wait for the worker thread, which has finished or is about to, and release its image
+static void finish_loading(struct viv_server *server) {
+    pthread_join(server->background.loading_thread, NULL);
+    wl_event_source_remove(server->background.loaded_source);
+    server->background.loaded_source = NULL;
+    free_image(server->background.loading);
+    server->background.loading = NULL;
+}
+
+/// Upload the decoded image once it is ready, which every output then draws from. If it
+/// couldn't be decoded or uploaded, swaybg is left to try instead.
+static int handle_image_loaded(int fd, uint32_t mask, void *data) {
+    UNUSED(fd);
+    UNUSED(mask);
+    struct viv_server *server = data;
+    struct viv_background_image *image = server->background.loading;
+
+    struct wlr_texture *texture = NULL;
+    if (image->pixels) {
+        texture = wlr_texture_from_pixels(server->renderer, DRM_FORMAT_ABGR8888, image->stride,
+                                          image->width, image->height, image->pixels);
+        if (texture == NULL) {
+            wlr_log(WLR_ERROR, "Could not upload background image \"%s\"", image->path);
+        }
+    } else {
+        wlr_log(WLR_ERROR, "Could not load background image \"%s\": %s", image->path,
+                image->error ? image->error : "unknown error");
+    }
+
+    if (texture) {
+        wlr_log(WLR_INFO, "Loaded %dx%d background image \"%s\"", image->width, image->height, image->path);
+        server->background.texture = texture;
+        server->background.generation++;
+
+        struct viv_output *output;
+        wl_list_for_each(output, &server->outputs, link) {
+            viv_output_damage(output);
+        }
+    } else {
+        run_swaybg(server->config->background.colour, server->config->background.image,
+                   server->config->background.mode);
+    }
+
+    finish_loading(server);
+    return 0;
+}
+
+/// Start decoding the image in a worker thread. Returns false if the thread couldn't be
+/// started.
+static bool start_loading(struct viv_server *server, char *path) {
+    struct viv_background_image *image = calloc(1, sizeof(struct viv_background_image));
+    CHECK_ALLOCATION(image);
+    image->path = strdup(path);
+    CHECK_ALLOCATION(image->path);
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        wlr_log_errno(WLR_ERROR, "Could not create a pipe for loading the background image");
+        free(image->path);
+        free(image);
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    image->done_read_fd = fds[0];
+    image->done_fd = fds[1];
+
+    if (pthread_create(&server->background.loading_thread, NULL, decode_image, image) != 0) {
+        wlr_log(WLR_ERROR, "Could not start a thread to load the background image");
+        free_image(image);
+        return false;
+    }
+
+    server->background.loading = image;
+    struct wl_event_loop *event_loop = wl_display_get_event_loop(server->wl_display);
+    server->background.loaded_source = wl_event_loop_add_fd(event_loop, image->done_read_fd, WL_EVENT_READABLE,
+                                                            handle_image_loaded, server);
+    CHECK_ALLOCATION(server->background.loaded_source);
+    return true;
+}
+#endif
+
+void viv_background_init(struct viv_server *server) {
+    char *colour = server->config->background.colour;
+    char *image = server->config->background.image;
+    char *mode = server->config->background.mode;
     bool colour_valid = (colour != NULL) && strlen(colour);
     bool image_valid = (image != NULL) && strlen(image);
     bool mode_valid = (mode != NULL) && strlen(mode);
     if (!colour_valid && !image_valid && !mode_valid) {
-        // Nothing is configured so just don't run swaybg
         wlr_log(WLR_INFO, "No background config, skipping");
         return;
     }
 
+    if (colour_valid) {
+        server->background.has_colour = parse_colour(colour, server->background.colour);
+        if (!server->background.has_colour) {
+            wlr_log(WLR_ERROR, "Invalid background colour \"%s\", expected e.g. \"#bbbbbb\"", colour);
+        }
+    }
+
+    server->background.mode = VIV_BACKGROUND_MODE_FILL;
+    if (mode_valid && !parse_mode(mode, &server->background.mode)) {
+        wlr_log(WLR_ERROR, "Invalid background mode \"%s\", using \"fill\"", mode);
+    }
+
+    if (!image_valid || (server->background.mode == VIV_BACKGROUND_MODE_SOLID_COLOUR)) {
+        // The colour replaces the clear colour, so there's nothing else to draw
+        return;
+    }
+
+#ifdef BACKGROUND_IMAGE
+    if (start_loading(server, image)) {
+        return;
+    }
+#endif
+    // Without the built-in image loader, swaybg draws the image in a background layer view
     run_swaybg(colour, image, mode);
 }
+
+void viv_background_fini(struct viv_server *server) {
+#ifdef BACKGROUND_IMAGE
+    if (server->background.loading) {
+        finish_loading(server);
+    }
+#endif
+    if (server->background.texture) {
+        wlr_texture_destroy(server->background.texture);
+        server->background.texture = NULL;
+    }
+}
+
+const float *viv_background_get_colour(struct viv_server *server) {
+    if (server->background.has_colour) {
+        return server->background.colour;
+    }
+    return server->config->clear_colour;
+}
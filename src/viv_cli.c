@@ -17,6 +17,7 @@
     MACRO("help", help, no_argument, 0, 'h')                       \
     MACRO("list-config-options", list_config_options, no_argument, 0, 0) \
     MACRO("config", set_config_path, required_argument, 0, 0) \
+    MACRO("software-renderer", use_software_renderer, no_argument, 0, 0) \
 
 #define GENERATE_OPTION_STRUCT(CLI_NAME, FUNC_NAME, HAS_ARG, FLAG, VAL)  \
     {CLI_NAME, HAS_ARG, FLAG, VAL},
@@ -24,11 +25,12 @@
 static bool handle_help(struct viv_args *args) {
     UNUSED(args);
     printf(
-        "Usage: vivarium [-h] [--list-config-options] [--config]\n"
+        "Usage: vivarium [-h] [--list-config-options] [--config] [--software-renderer]\n"
         "\n"
         "-h, --help               Show help message and quit\n"
         "--list-config-options    List available layouts and keybinds\n"
         "--config                 Path to config file to load, overrides normal config\n"
+        "--software-renderer      Render on the CPU with pixman, overrides the configured renderer\n"
         "\n"
     );
 
@@ -77,6 +79,11 @@ static bool handle_set_config_path(struct viv_args *args) {
     return false;
 }
 
+static bool handle_use_software_renderer(struct viv_args *args) {
+    args->software_renderer = true;
+    return false;
+}
+
 #define GENERATE_OPTION_HANDLER_LOOKUP(CLI_NAME, FUNC_NAME, HAS_ARG, FLAG, VAL) \
     &handle_ ## FUNC_NAME,
 
@@ -5,6 +5,7 @@
 #include "viv_cursor.h"
 #include "viv_layer_view.h"
 #include "viv_output.h"
+#include "viv_render.h"
 #include "viv_seat.h"
 #include "viv_server.h"
 #include "viv_types.h"
@@ -121,6 +122,7 @@ static void process_cursor_pass_through_to_surface(struct viv_seat *seat, uint32
         if (layer_view_wants_keyboard_focus(layer_view)) {
             viv_seat_focus_layer_view(seat, layer_view);
             server->active_output->current_workspace->active_view = NULL;
+            viv_render_invalidate_entries(server);
         }
     } else if (view) {
         // View under the cursor and not already active => focus it if appropriate
@@ -1,24 +1,78 @@
-
 #include <pixman-1/pixman.h>
 #include <wayland-util.h>
 #include <wlr/types/wlr_output_damage.h>
+#include <wlr/types/wlr_output_layout.h>
 
+#include "viv_damage.h"
 #include "viv_output.h"
+#include "viv_render.h"
 #include "viv_types.h"
+#include "viv_view.h"
+
+/// True if any part of the given region, in layout coords, lies on the output
+static bool region_overlaps_output(struct viv_output *output, pixman_region32_t *region) {
+    pixman_box32_t *extents = pixman_region32_extents(region);
+    struct wlr_box extents_box = {
+        .x = extents->x1,
+        .y = extents->y1,
+        .width = extents->x2 - extents->x1,
+        .height = extents->y2 - extents->y1,
+    };
+    return wlr_output_layout_intersects(output->server->output_layout, output->wlr_output, &extents_box);
+}
+
+void viv_damage_layout_region(struct viv_server *server, struct viv_view *view, pixman_region32_t *damage) {
+    if (!pixman_region32_not_empty(damage)) {
+        return;
+    }
 
+    if (view && (view->workspace->output == NULL)) {
+        // Nothing on a hidden workspace can be seen
+        return;
+    }
+
+    struct viv_output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        if (output->powered_off || !region_overlaps_output(output, damage)) {
+            continue;
+        }
 
-/// Apply the damage from this surface to every output
-void viv_damage_surface(struct viv_server *server, struct wlr_surface *surface, int lx, int ly) {
+        if (view == NULL) {
+            viv_output_damage_layout_coords_region(output, damage);
+            continue;
+        }
+
+        if (!viv_view_is_visible_on_output(view, output)) {
+            continue;
+        }
+
+        pixman_region32_t occluded;
+        pixman_region32_init(&occluded);
+        if (viv_render_get_view_occlusion(output, view, &occluded)) {
+            // The occluded region is in the output's scaled coords, so the damage must be
+            // converted to match before anything is subtracted
+            pixman_region32_t visible_damage;
+            pixman_region32_init(&visible_damage);
+            viv_output_layout_coords_region_to_output_coords(output, &visible_damage, damage, VIV_GEOMETRY_ROUND_OUTWARD);
+            pixman_region32_subtract(&visible_damage, &visible_damage, &occluded);
+            wlr_output_damage_add(output->damage, &visible_damage);
+            if (pixman_region32_not_empty(&visible_damage)) {
+                viv_output_notify_activity(output);
+            }
+            pixman_region32_fini(&visible_damage);
+        }
+        pixman_region32_fini(&occluded);
+    }
+}
+
+void viv_damage_surface(struct viv_server *server, struct viv_view *view, struct wlr_surface *surface, int lx, int ly) {
     pixman_region32_t damage;
     pixman_region32_init(&damage);
     wlr_surface_get_effective_damage(surface, &damage);
 
     pixman_region32_translate(&damage, lx, ly);
 
-    struct viv_output *output;
-    wl_list_for_each(output, &server->outputs, link) {
-        viv_output_damage_layout_coords_region(output, &damage);
-    }
+    viv_damage_layout_region(server, view, &damage);
 
     pixman_region32_fini(&damage);
 }
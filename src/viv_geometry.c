@@ -0,0 +1,287 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "viv_config_support.h"
+#include "viv_geometry.h"
+
+/// Scale an unscaled output-local edge coordinate. is_start should be true for the left or
+/// top edge of a box, and false for the right or bottom edge.
+static int scale_edge(double edge, float scale, bool is_start, enum viv_geometry_rounding rounding) {
+    double scaled_edge = edge * scale;
+    switch (rounding) {
+    case VIV_GEOMETRY_ROUND_NEAREST:
+        return round(scaled_edge);
+    case VIV_GEOMETRY_ROUND_OUTWARD:
+        return is_start ? floor(scaled_edge) : ceil(scaled_edge);
+    default:
+        UNREACHABLE();
+    }
+    return 0;
+}
+
+/// Convert a single rect, with the same rules as viv_geometry_layout_box_to_output_box
+static void layout_rect_to_output_rect(pixman_box32_t *output_rect, const pixman_box32_t *layout_rect,
+                                       double ox, double oy, float scale,
+                                       enum viv_geometry_rounding rounding) {
+    // Each edge is scaled separately, rather than scaling the width and height, so that
+    // boxes sharing an edge in layout coordinates still share it in output coordinates
+    output_rect->x1 = scale_edge(layout_rect->x1 + ox, scale, true, rounding);
+    output_rect->y1 = scale_edge(layout_rect->y1 + oy, scale, true, rounding);
+    output_rect->x2 = scale_edge(layout_rect->x2 + ox, scale, false, rounding);
+    output_rect->y2 = scale_edge(layout_rect->y2 + oy, scale, false, rounding);
+}
+
+void viv_geometry_layout_box_to_output_box(struct wlr_box *output_box, const struct wlr_box *layout_box,
+                                           double ox, double oy, float scale,
+                                           enum viv_geometry_rounding rounding) {
+    pixman_box32_t layout_rect = {
+        .x1 = layout_box->x,
+        .y1 = layout_box->y,
+        .x2 = layout_box->x + layout_box->width,
+        .y2 = layout_box->y + layout_box->height,
+    };
+    pixman_box32_t output_rect;
+    layout_rect_to_output_rect(&output_rect, &layout_rect, ox, oy, scale, rounding);
+
+    output_box->x = output_rect.x1;
+    output_box->y = output_rect.y1;
+    output_box->width = output_rect.x2 - output_rect.x1;
+    output_box->height = output_rect.y2 - output_rect.y1;
+}
+
+/// Make sure a scratch array of boxes has room for count of them
+static void reserve_boxes(pixman_box32_t **boxes, size_t *capacity, size_t count, uint32_t *allocations) {
+    if (count <= *capacity) {
+        return;
+    }
+    size_t new_capacity = (count > *capacity * 2) ? count : *capacity * 2;
+    *boxes = realloc(*boxes, new_capacity * sizeof(pixman_box32_t));
+    CHECK_ALLOCATION(*boxes);
+    *capacity = new_capacity;
+    (*allocations)++;
+}
+
+/// Make sure the scratch region has room for count rects, returning where its rects start
+static pixman_box32_t *reserve_region_rects(struct viv_geometry_scratch *scratch, size_t count) {
+    if (count > scratch->region_capacity) {
+        size_t new_capacity = (count > scratch->region_capacity * 2) ? count : scratch->region_capacity * 2;
+        scratch->region = realloc(scratch->region,
+                                  sizeof(pixman_region32_data_t) + new_capacity * sizeof(pixman_box32_t));
+        CHECK_ALLOCATION(scratch->region);
+        scratch->region_capacity = new_capacity;
+        scratch->allocations++;
+    }
+    return (pixman_box32_t *)(scratch->region + 1);
+}
+
+/// Sort a row of spans by their left edge and merge any that touch or overlap, returning
+/// how many are left
+static size_t merge_row_spans(pixman_box32_t *spans, size_t count) {
+    // Each band's spans are already sorted, so the row is mostly in order
+    for (size_t i = 1; i < count; i++) {
+        pixman_box32_t span = spans[i];
+        size_t j = i;
+        while ((j > 0) && (spans[j - 1].x1 > span.x1)) {
+            spans[j] = spans[j - 1];
+            j--;
+        }
+        spans[j] = span;
+    }
+
+    size_t merged = 0;
+    for (size_t i = 0; i < count; i++) {
+        if ((merged > 0) && (spans[i].x1 <= spans[merged - 1].x2)) {
+            if (spans[i].x2 > spans[merged - 1].x2) {
+                spans[merged - 1].x2 = spans[i].x2;
+            }
+        } else {
+            spans[merged++] = spans[i];
+        }
+    }
+    return merged;
+}
+
+/// Convert each rect of the region, keeping them grouped into the region's bands. Rects
+/// that round to nothing are dropped, and any that now touch or overlap the previous rect
+/// in their band are merged into it. Returns the number of bands.
+static size_t convert_region_bands(struct viv_geometry_scratch *scratch, pixman_region32_t *src,
+                                   double ox, double oy, float scale, enum viv_geometry_rounding rounding) {
+    int num_rects;
+    pixman_box32_t *rects = pixman_region32_rectangles(src, &num_rects);
+    reserve_boxes(&scratch->rects, &scratch->rects_capacity, num_rects, &scratch->allocations);
+    reserve_boxes(&scratch->bands, &scratch->bands_capacity, num_rects, &scratch->allocations);
+
+    size_t num_converted = 0;
+    size_t num_bands = 0;
+    int32_t band_layout_y1 = 0;
+    for (int i = 0; i < num_rects; i++) {
+        pixman_box32_t rect;
+        layout_rect_to_output_rect(&rect, &rects[i], ox, oy, scale, rounding);
+        if ((rect.x1 >= rect.x2) || (rect.y1 >= rect.y2)) {
+            continue;
+        }
+
+        if ((num_bands == 0) || (rects[i].y1 != band_layout_y1)) {
+            scratch->bands[num_bands++] = (pixman_box32_t){
+                .x1 = num_converted,
+                .y1 = rect.y1,
+                .x2 = num_converted,
+                .y2 = rect.y2,
+            };
+            band_layout_y1 = rects[i].y1;
+        }
+
+        pixman_box32_t *band = &scratch->bands[num_bands - 1];
+        if ((band->x2 > band->x1) && (rect.x1 <= scratch->rects[num_converted - 1].x2)) {
+            pixman_box32_t *previous = &scratch->rects[num_converted - 1];
+            if (rect.x2 > previous->x2) {
+                previous->x2 = rect.x2;
+            }
+        } else {
+            scratch->rects[num_converted++] = rect;
+            band->x2 = num_converted;
+        }
+    }
+    return num_bands;
+}
+
+void viv_geometry_layout_region_to_output_region(pixman_region32_t *dst, pixman_region32_t *src,
+                                                 double ox, double oy, float scale,
+                                                 enum viv_geometry_rounding rounding,
+                                                 struct viv_geometry_scratch *scratch) {
+    ASSERT(dst != src);
+
+    if ((scale == 1) && (ox == floor(ox)) && (oy == floor(oy))) {
+        // Nothing needs rounding, and copying lets dst keep reusing its storage
+        pixman_region32_copy(dst, src);
+        pixman_region32_translate(dst, ox, oy);
+        return;
+    }
+
+    size_t num_bands = convert_region_bands(scratch, src, ox, oy, scale, rounding);
+    if (num_bands == 0) {
+        pixman_region32_clear(dst);
+        return;
+    }
+
+    // Edges scale in order, so the converted bands are still sorted by both of their
+    // edges, but bands rounded outwards (or squashed by a small scale) may now overlap.
+    // Sweep down them, emitting a row of rects for each stretch covered by the same bands,
+    // so that the result is laid out as pixman expects without pixman having to sort it.
+    pixman_box32_t *bands = scratch->bands;
+    size_t num_output = 0;
+    size_t previous_row = 0, previous_row_count = 0;
+    pixman_box32_t extents = { .x1 = INT32_MAX, .x2 = INT32_MIN };
+    size_t first = 0;
+    int32_t y = bands[0].y1;
+    while (first < num_bands) {
+        if (bands[first].y2 <= y) {
+            first++;
+            continue;
+        }
+        if (bands[first].y1 > y) {
+            y = bands[first].y1;
+        }
+
+        size_t end = first;
+        size_t row_count = 0;
+        while ((end < num_bands) && (bands[end].y1 <= y)) {
+            row_count += bands[end].x2 - bands[end].x1;
+            end++;
+        }
+        int32_t row_y2 = bands[first].y2;
+        if ((end < num_bands) && (bands[end].y1 < row_y2)) {
+            row_y2 = bands[end].y1;
+        }
+
+        pixman_box32_t *output_rects = reserve_region_rects(scratch, num_output + row_count);
+        pixman_box32_t *row = &output_rects[num_output];
+        size_t i = 0;
+        for (size_t band = first; band < end; band++) {
+            for (int32_t rect = bands[band].x1; rect < bands[band].x2; rect++) {
+                row[i] = scratch->rects[rect];
+                row[i].y1 = y;
+                row[i].y2 = row_y2;
+                i++;
+            }
+        }
+        if (end - first > 1) {
+            row_count = merge_row_spans(row, row_count);
+        }
+
+        // Extend the previous row instead if it has the same spans and meets this one
+        bool same_as_previous = (previous_row_count == row_count) && (output_rects[previous_row].y2 == y);
+        for (size_t j = 0; same_as_previous && (j < row_count); j++) {
+            same_as_previous = (output_rects[previous_row + j].x1 == row[j].x1) &&
+                (output_rects[previous_row + j].x2 == row[j].x2);
+        }
+        if (same_as_previous) {
+            for (size_t j = 0; j < row_count; j++) {
+                output_rects[previous_row + j].y2 = row_y2;
+            }
+        } else {
+            previous_row = num_output;
+            previous_row_count = row_count;
+            num_output += row_count;
+        }
+
+        if (row[0].x1 < extents.x1) {
+            extents.x1 = row[0].x1;
+        }
+        if (row[row_count - 1].x2 > extents.x2) {
+            extents.x2 = row[row_count - 1].x2;
+        }
+        y = row_y2;
+    }
+
+    // Copy out of a region that uses the scratch rects, so that dst reuses its own storage
+    pixman_box32_t *output_rects = (pixman_box32_t *)(scratch->region + 1);
+    extents.y1 = output_rects[0].y1;
+    extents.y2 = output_rects[num_output - 1].y2;
+    pixman_region32_t converted = {
+        .extents = extents,
+        .data = NULL,
+    };
+    if (num_output > 1) {
+        // pixman keeps a single rect in the extents alone
+        scratch->region->size = scratch->region_capacity;
+        scratch->region->numRects = num_output;
+        converted.data = scratch->region;
+    }
+    pixman_region32_copy(dst, &converted);
+}
+
+void viv_geometry_scratch_fini(struct viv_geometry_scratch *scratch) {
+    free(scratch->rects);
+    free(scratch->bands);
+    free(scratch->region);
+}
+
+void viv_geometry_fit_box(struct wlr_box *box, int width, int height, int dst_width, int dst_height,
+                          enum viv_geometry_fit fit) {
+    double x_scale = (double)dst_width / width;
+    double y_scale = (double)dst_height / height;
+    switch (fit) {
+    case VIV_GEOMETRY_FIT_STRETCH:
+        break;
+    case VIV_GEOMETRY_FIT_FILL:
+        x_scale = y_scale = fmax(x_scale, y_scale);
+        break;
+    case VIV_GEOMETRY_FIT_FIT:
+        x_scale = y_scale = fmin(x_scale, y_scale);
+        break;
+    case VIV_GEOMETRY_FIT_CENTER:
+        x_scale = y_scale = 1;
+        break;
+    default:
+        UNREACHABLE();
+    }
+
+    box->width = round(width * x_scale);
+    box->height = round(height * y_scale);
+    // Halve the difference rather than the position, so that overflow is split evenly too
+    box->x = (dst_width - box->width) / 2;
+    box->y = (dst_height - box->height) / 2;
+}
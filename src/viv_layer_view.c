@@ -8,6 +8,7 @@
 #include "viv_damage.h"
 #include "viv_layer_view.h"
 #include "viv_output.h"
+#include "viv_render.h"
 #include "viv_seat.h"
 #include "viv_server.h"
 #include "viv_types.h"
@@ -15,6 +16,10 @@
 #include "viv_wlr_surface_tree.h"
 #include "viv_xdg_popup.h"
 
+#ifdef SCENE_RENDERER
+#include "viv_scene.h"
+#endif
+
 static void add_layer_view_global_coords(void *layer_view_pointer, int *x, int *y) {
     struct viv_layer_view *view = layer_view_pointer;
     *x += view->x;
@@ -29,7 +34,10 @@ static void layer_surface_map(struct wl_listener *listener, void *data) {
 
     viv_output_mark_for_relayout(layer_view->output);
 
-    layer_view->surface_tree = viv_surface_tree_root_create(layer_view->server, layer_view->layer_surface->surface, &add_layer_view_global_coords, layer_view);
+    layer_view->surface_tree = viv_surface_tree_root_create(layer_view->server, layer_view->layer_surface->surface, &add_layer_view_global_coords, layer_view, NULL);
+#ifdef SCENE_RENDERER
+    viv_scene_layer_view_map(layer_view);
+#endif
 
     if (layer_view->layer_surface->current.keyboard_interactive) {
         struct viv_seat *seat = viv_server_get_default_seat(layer_view->server);
@@ -67,6 +75,10 @@ static void layer_surface_unmap(struct wl_listener *listener, void *data) {
     } else {
         wlr_log(WLR_ERROR, "Layer view had no surface tree during unmap");
     }
+
+#ifdef SCENE_RENDERER
+    viv_scene_layer_view_unmap(layer_view);
+#endif
 }
 
 static void layer_surface_destroy(struct wl_listener *listener, void *data) {
@@ -77,6 +89,7 @@ static void layer_surface_destroy(struct wl_listener *listener, void *data) {
     // TODO: unfocus this as the keyboard surface if necessary
 
 	wl_list_remove(&layer_view->output_link);
+    viv_render_invalidate_entries(layer_view->server);
 
     viv_output_mark_for_relayout(layer_view->output);
 
@@ -84,6 +97,9 @@ static void layer_surface_destroy(struct wl_listener *listener, void *data) {
         viv_surface_tree_destroy(layer_view->surface_tree);
         layer_view->surface_tree = NULL;
     }
+#ifdef SCENE_RENDERER
+    viv_scene_layer_view_unmap(layer_view);
+#endif
 
     wl_list_remove(&layer_view->map.link);
     wl_list_remove(&layer_view->unmap.link);
@@ -102,6 +118,9 @@ static void layer_surface_new_popup(struct wl_listener *listener, void *data) {
 
     popup->lx = &layer_view->x;
     popup->ly = &layer_view->y;
+#ifdef SCENE_RENDERER
+    popup->parent_scene_node = &layer_view->scene_node;
+#endif
     popup->server = layer_view->server;
     viv_xdg_popup_init(popup, wlr_popup);
 
@@ -359,3 +359,34 @@ void viv_mappable_debug_next_damage_tracking_mode(struct viv_workspace *workspac
         config->damage_tracking_mode = (enum viv_damage_tracking_mode)0;
     }
 }
+
+static const char *adaptive_sync_status_name(enum wlr_output_adaptive_sync_status status) {
+    switch (status) {
+    case WLR_OUTPUT_ADAPTIVE_SYNC_DISABLED:
+        return "disabled";
+    case WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED:
+        return "enabled";
+    case WLR_OUTPUT_ADAPTIVE_SYNC_UNKNOWN:
+        return "unknown";
+    }
+    return "invalid";
+}
+
+void viv_mappable_debug_log_render_stats(struct viv_workspace *workspace, union viv_mappable_payload payload) {
+    UNUSED(payload);
+    struct viv_output *output;
+    wl_list_for_each(output, &workspace->server->outputs, link) {
+        struct viv_render_stats *stats = &output->render_stats;
+        wlr_log(WLR_INFO, "Output \"%s\" render stats: culled surfaces %u, hidden views %u, direct scanout %s "
+                "(%u frames, %u switches), "
+                "allocations %u, damage rects %u before coalescing and %u after, render delay %d ms, "
+                "missed deadlines %u, %s frame, damage mode switches %u, adaptive sync %s",
+                output->wlr_output->name, stats->culled_surfaces, stats->hidden_views,
+                stats->scanout_active ? "active" : "inactive", stats->scanout_frames, stats->scanout_switches,
+                stats->allocations,
+                stats->damage_rects_before, stats->damage_rects_after,
+                stats->render_delay_msec, stats->missed_deadlines,
+                stats->whole_frame ? "whole" : "partial", stats->damage_mode_switches,
+                adaptive_sync_status_name(output->wlr_output->adaptive_sync_status));
+    }
+}
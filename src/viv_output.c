@@ -1,10 +1,16 @@
-#include <math.h>
+#include <string.h>
+#include <time.h>
 #include <wayland-server-core.h>
+#include <wlr/backend.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/util/region.h>
 
 #include "viv_output.h"
 
+#include "viv_config_types.h"
 #include "viv_cursor.h"
 #include "viv_ipc.h"
 #include "viv_layer_view.h"
@@ -14,11 +20,71 @@
 #include "viv_view.h"
 #include "viv_workspace.h"
 
+#ifdef SCENE_RENDERER
+#include "viv_scene.h"
+#endif
+
+#define NSEC_PER_SEC 1000000000
+#define NSEC_PER_MSEC 1000000
+
+// Extra time allowed on top of the measured render time, when estimating it automatically
+#define AUTO_RENDER_TIME_MARGIN_NSEC (2 * NSEC_PER_MSEC)
+
+/// Whether any mirror output is showing the given output
+static bool output_is_mirrored(struct viv_output *output) {
+    struct viv_output *mirror;
+    wl_list_for_each(mirror, &output->server->mirror_outputs, link) {
+        if (mirror->mirror.source == output) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Start showing the given source output on the mirror output, or stop showing anything
+/// if source is NULL
+static void set_mirror_source(struct viv_output *mirror, struct viv_output *source) {
+    wlr_log(WLR_INFO, "Output \"%s\": %s mirroring \"%s\"", mirror->wlr_output->name,
+            source ? "started" : "stopped", mirror->config->mirror);
+    mirror->mirror.source = source;
+    viv_output_damage(mirror);
+    if (source) {
+        // The source's current buffer isn't known until it next commits one
+        viv_output_damage(source);
+    }
+}
+
+/// Start using the mirror output, i.e. show the output it mirrors if that exists yet
+static void start_using_mirror_output(struct viv_output *output) {
+    struct viv_server *server = output->server;
+    wl_list_insert(&server->mirror_outputs, &output->link);
+
+    struct viv_output *source;
+    wl_list_for_each(source, &server->outputs, link) {
+        if (strcmp(source->wlr_output->name, output->config->mirror) == 0) {
+            set_mirror_source(output, source);
+            break;
+        }
+    }
+}
+
 /// Start using the output, i.e. add it to our output layout and draw a workspace on it
 static void start_using_output(struct viv_output *output) {
     struct viv_server *server = output->server;
+    if (output->mirror.is_mirror) {
+        start_using_mirror_output(output);
+        return;
+    }
+
     wl_list_insert(&server->outputs, &output->link);
 
+    struct viv_output *mirror;
+    wl_list_for_each(mirror, &server->mirror_outputs, link) {
+        if (strcmp(mirror->config->mirror, output->wlr_output->name) == 0) {
+            set_mirror_source(mirror, output);
+        }
+    }
+
     struct viv_workspace *current_workspace;
     wl_list_for_each(current_workspace, &server->workspaces, server_link) {
         if (current_workspace->output == NULL) {
@@ -29,6 +95,8 @@ static void start_using_output(struct viv_output *output) {
     }
 
 	wlr_output_layout_add_auto(server->output_layout, output->wlr_output);
+
+    viv_render_invalidate_entries(server);
 }
 
 /// Remove the output from our output layout, revoke its workspace assignation, and clean
@@ -36,6 +104,16 @@ static void start_using_output(struct viv_output *output) {
 static void stop_using_output(struct viv_output *output) {
     struct viv_server *server = output->server;
     wl_list_remove(&output->link);
+    if (output->mirror.is_mirror) {
+        return;
+    }
+
+    struct viv_output *mirror;
+    wl_list_for_each(mirror, &server->mirror_outputs, link) {
+        if (mirror->mirror.source == output) {
+            set_mirror_source(mirror, NULL);
+        }
+    }
 
     if (server->active_output == output) {
         server->active_output = NULL;
@@ -64,6 +142,8 @@ static void stop_using_output(struct viv_output *output) {
 
     wlr_output_layout_remove(server->output_layout, output->wlr_output);
 
+    viv_render_invalidate_entries(server);
+
     // Clean up layer views last, to ensure that none of the cleanup tries to access
     // still-initialised output state
     struct viv_layer_view *layer_view;
@@ -74,26 +154,107 @@ static void stop_using_output(struct viv_output *output) {
 
 }
 
-/// Handle a render frame event: render everything on the output, then do any scheduled relayouts
-static void output_frame(struct wl_listener *listener, void *data) {
-    UNUSED(data);
+static int64_t timespec_to_nsec(struct timespec *time) {
+    return (int64_t)time->tv_sec * NSEC_PER_SEC + time->tv_nsec;
+}
 
-    // This has been called because a specific output is ready to display a frame,
-    // retrieve this info
-	struct viv_output *output = wl_container_of(listener, output, frame);
-	struct wlr_renderer *renderer = output->server->renderer;
+/// Get the time, in ms, that must be left before the next vblank for rendering
+static int get_max_render_time_msec(struct viv_output *output) {
+    int max_render_time = output->server->config->render.max_render_time;
+    if (max_render_time >= 0) {
+        return max_render_time;
+    }
+
+    // Automatic: allow for the slowest recent render plus a margin, rounding up
+    int64_t render_time_nsec = output->render_schedule.render_time_estimate_nsec + AUTO_RENDER_TIME_MARGIN_NSEC;
+    return (render_time_nsec + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC;
+}
+
+/// Get how long to wait before rendering so that the render finishes just before the next
+/// vblank, recording that vblank as the deadline. Returns 0 or less if the output should
+/// be rendered right away.
+static int get_render_delay_msec(struct viv_output *output) {
+    struct viv_server *server = output->server;
+    if (server->config->render.max_render_time == 0) {
+        return 0;
+    }
+
+    if (output->mirror.is_mirror) {
+        // Mirrors have no clients of their own to wait for
+        return 0;
+    }
+
+    if (output->render_schedule.refresh_nsec <= 0) {
+        // The refresh rate isn't known (e.g. a nested backend), so vblanks can't be predicted
+        return 0;
+    }
+
+    struct timespec now;
+    clock_gettime(wlr_backend_get_presentation_clock(server->backend), &now);
+    int64_t now_nsec = timespec_to_nsec(&now);
+    int64_t vblank_nsec = output->render_schedule.last_presentation_nsec + output->render_schedule.refresh_nsec;
+    if (vblank_nsec <= now_nsec) {
+        // The predicted vblank has already passed, so there's no point waiting for it
+        return 0;
+    }
+    output->render_schedule.predicted_vblank_nsec = vblank_nsec;
+
+    // Round down, it's better to render slightly too early than to miss the vblank
+    int msec_until_vblank = (vblank_nsec - now_nsec) / NSEC_PER_MSEC;
+    return msec_until_vblank - get_max_render_time_msec(output);
+}
+
+/// Render everything on the output, then do any scheduled relayouts
+static void render_output_now(struct viv_output *output) {
+    struct viv_server *server = output->server;
+    clockid_t presentation_clock = wlr_backend_get_presentation_clock(server->backend);
 
 #ifdef DEBUG
     viv_check_data_consistency(output->server);
 #endif
 
-    viv_render_output(renderer, output);
+    // The CPU time is tracked separately, as most of the software renderer's cost
+    struct timespec start, end, cpu_start, cpu_end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+    clock_gettime(presentation_clock, &start);
+    if (output->mirror.is_mirror) {
+        viv_render_mirror_output(server->renderer, output);
+    } else {
+#ifdef SCENE_RENDERER
+        viv_scene_render_output(output);
+#else
+        viv_render_output(server->renderer, output);
+#endif
+    }
+    clock_gettime(presentation_clock, &end);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+
+    int64_t render_time_nsec = timespec_to_nsec(&end) - timespec_to_nsec(&start);
+    output->render_stats.frames_rendered++;
+    output->render_stats.total_render_nsec += render_time_nsec;
+    if (render_time_nsec > output->render_stats.max_render_nsec) {
+        output->render_stats.max_render_nsec = render_time_nsec;
+    }
+    output->render_stats.total_render_cpu_nsec += timespec_to_nsec(&cpu_end) - timespec_to_nsec(&cpu_start);
+
+    // Decay the estimate slowly, so that it still accounts for occasional slow frames
+    int64_t decayed_estimate_nsec = output->render_schedule.render_time_estimate_nsec * 15 / 16;
+    output->render_schedule.render_time_estimate_nsec = ((render_time_nsec > decayed_estimate_nsec) ?
+                                                         render_time_nsec : decayed_estimate_nsec);
+
+    if (output->render_schedule.frame_done_sent) {
+        // This render was delayed, check whether it was delayed too much
+        if (timespec_to_nsec(&end) > output->render_schedule.predicted_vblank_nsec) {
+            output->render_stats.missed_deadlines++;
+        }
+        output->render_schedule.frame_done_sent = false;
+    }
 
     // If the workspace has been been relayout recently, reset the pointer focus just in
     // case surfaces have changed size since the last frame
     // TODO: There must be a better way to do this
     struct viv_workspace *workspace = output->current_workspace;
-    if (workspace->was_laid_out) {
+    if (workspace && workspace->was_laid_out) {
         struct timespec now;
         clock_gettime(CLOCK_MONOTONIC, &now);
         viv_cursor_reset_focus(workspace->server, (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000);
@@ -103,11 +264,214 @@ static void output_frame(struct wl_listener *listener, void *data) {
     // TODO this probably shouldn't be here?  For now do layout right after committing a
     // frame, to give time for clients to re-draw before the next one. There's probably a
     // better way to do this.
-    viv_output_do_layout_if_necessary(output);
+    if (workspace) {
+        viv_output_do_layout_if_necessary(output);
+    }
 
     viv_routine_log_state(output->server);
 }
 
+/// Get the interval between frame callbacks for views on the output while it's powered off,
+/// or 0 if they get none
+static int get_powered_off_frame_interval_msec(struct viv_output *output) {
+    double rate = output->server->config->render.powered_off_frame_rate;
+    if (rate <= 0) {
+        return 0;
+    }
+    // A 0 interval would disarm the timer, so very fast rates get callbacks every 1 ms
+    int interval_msec = 1000 / rate;
+    return (interval_msec > 0) ? interval_msec : 1;
+}
+
+/// Send frame callbacks to views whose frames are paced by the powered-off output, so that
+/// their clients keep making slow progress rather than stalling or drawing at full rate
+static int handle_powered_off_timer(void *data) {
+    struct viv_output *output = data;
+    if (!output->powered_off) {
+        return 0;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    viv_render_send_frame_done(output, &now);
+
+    wl_event_source_timer_update(output->powered_off_timer, get_powered_off_frame_interval_msec(output));
+    return 0;
+}
+
+static int64_t get_monotonic_msec(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/// Drop to the idle refresh rate once the output has gone without damage or input for the
+/// configured timeout, otherwise check again when it could next have done
+static int handle_idle_refresh_timer(void *data) {
+    struct viv_output *output = data;
+    struct wlr_output *wlr_output = output->wlr_output;
+    if (output->idle_refresh.downclocked) {
+        return 0;
+    }
+
+    int64_t idle_msec = get_monotonic_msec() - output->idle_refresh.last_activity_msec;
+    if (idle_msec < output->idle_refresh.timeout_msec) {
+        wl_event_source_timer_update(output->idle_refresh.timer,
+                                     output->idle_refresh.timeout_msec - idle_msec);
+        return 0;
+    }
+    if (output->powered_off || !wlr_output->enabled || pixman_region32_not_empty(&output->damage->current)) {
+        wl_event_source_timer_update(output->idle_refresh.timer, output->idle_refresh.timeout_msec);
+        return 0;
+    }
+
+    struct viv_output_mode_choice idle_mode;
+    if (!viv_output_mode_choose_idle(&wlr_output->modes, wlr_output->width, wlr_output->height,
+                                     wlr_output->refresh, output->idle_refresh.refresh, &idle_mode)) {
+        wlr_log(WLR_DEBUG, "Output \"%s\" has no mode slower than %d mHz to idle in",
+                wlr_output->name, wlr_output->refresh);
+        wl_event_source_timer_update(output->idle_refresh.timer, output->idle_refresh.timeout_msec);
+        return 0;
+    }
+
+    struct viv_output_mode_choice restore_mode = {
+        .mode = wlr_output->current_mode,
+        .width = wlr_output->width,
+        .height = wlr_output->height,
+        .refresh = wlr_output->refresh,
+    };
+    viv_output_mode_set(wlr_output, &idle_mode);
+    if (!wlr_output_commit(wlr_output)) {
+        wlr_log(WLR_ERROR, "Output \"%s\" failed to switch to %d mHz while idle", wlr_output->name,
+                idle_mode.refresh);
+        wl_event_source_timer_update(output->idle_refresh.timer, output->idle_refresh.timeout_msec);
+        return 0;
+    }
+
+    wlr_log(WLR_INFO, "Output \"%s\" idle, refresh rate lowered from %d to %d mHz", wlr_output->name,
+            restore_mode.refresh, wlr_output->refresh);
+    output->idle_refresh.restore_mode = restore_mode;
+    output->idle_refresh.downclocked = true;
+    output->idle_refresh.activity_pending = false;
+    return 0;
+}
+
+/// Go back to the mode the output had before idling, and start timing idleness again
+static void restore_full_refresh(struct viv_output *output) {
+    struct wlr_output *wlr_output = output->wlr_output;
+    viv_output_mode_set(wlr_output, &output->idle_refresh.restore_mode);
+    if (wlr_output_commit(wlr_output)) {
+        wlr_log(WLR_INFO, "Output \"%s\" active, refresh rate restored to %d mHz", wlr_output->name,
+                wlr_output->refresh);
+    } else {
+        wlr_log(WLR_ERROR, "Output \"%s\" failed to restore its refresh rate after idling", wlr_output->name);
+    }
+
+    output->idle_refresh.downclocked = false;
+    output->idle_refresh.activity_pending = false;
+    output->idle_refresh.last_activity_msec = get_monotonic_msec();
+    wl_event_source_timer_update(output->idle_refresh.timer, output->idle_refresh.timeout_msec);
+}
+
+/// Whether the output's adaptive sync policy wants adaptive sync enabled right now
+static bool wants_adaptive_sync(struct viv_output *output) {
+    if (!output->config) {
+        return false;
+    }
+    switch (output->config->adaptive_sync) {
+    case VIV_ADAPTIVE_SYNC_OFF:
+        return false;
+    case VIV_ADAPTIVE_SYNC_ON:
+        return true;
+    case VIV_ADAPTIVE_SYNC_FULLSCREEN_ONLY:
+        return output->current_workspace && output->current_workspace->fullscreen_view;
+    }
+    UNREACHABLE();
+}
+
+/// Enable or disable adaptive sync whenever the policy changes its mind, e.g. when a view
+/// goes fullscreen, which always damages the output and so reaches the next frame event.
+/// Runs from the frame event because no page flip is pending there.
+static void update_adaptive_sync(struct viv_output *output) {
+    bool enabled = wants_adaptive_sync(output);
+    if (enabled == output->adaptive_sync_requested) {
+        return;
+    }
+    // Only ask once, so that outputs without adaptive sync aren't asked again every frame
+    output->adaptive_sync_requested = enabled;
+
+    struct wlr_output *wlr_output = output->wlr_output;
+    wlr_output_enable_adaptive_sync(wlr_output, enabled);
+    if (!wlr_output_commit(wlr_output)) {
+        wlr_log(WLR_ERROR, "Output \"%s\" failed to %s adaptive sync", wlr_output->name,
+                enabled ? "enable" : "disable");
+        wlr_output_rollback(wlr_output);
+        return;
+    }
+    wlr_log(WLR_INFO, "Output \"%s\" adaptive sync %s", wlr_output->name,
+            (wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED) ? "enabled" : "disabled");
+}
+
+static int handle_render_timer(void *data) {
+    struct viv_output *output = data;
+    output->render_schedule.deferred = false;
+    if (output->powered_off) {
+        return 0;
+    }
+    render_output_now(output);
+    return 0;
+}
+
+/// Handle a render frame event: render the output, either right away or shortly before
+/// the next vblank so that the frame includes the latest client buffers
+static void output_frame(struct wl_listener *listener, void *data) {
+    UNUSED(data);
+
+    // This has been called because a specific output is ready to display a frame,
+    // retrieve this info
+	struct viv_output *output = wl_container_of(listener, output, frame);
+
+    if (output->powered_off) {
+        // Left over from before the output was powered off
+        return;
+    }
+
+    if (output->render_schedule.deferred) {
+        // Damage arriving during the delay schedules more frames, but the delayed render
+        // will draw it anyway
+        return;
+    }
+
+    // Only damage and input noted as activity count here, not the whole-output damage that
+    // wlroots adds for the mode switch into the idle mode, which is drawn at the idle rate
+    if (output->idle_refresh.downclocked && output->idle_refresh.activity_pending) {
+        // Draw from the next frame event, which comes at the restored refresh rate
+        restore_full_refresh(output);
+        viv_output_damage(output);
+        return;
+    }
+
+    update_adaptive_sync(output);
+
+    int delay_msec = get_render_delay_msec(output);
+    if (delay_msec < 1) {
+        output->render_stats.render_delay_msec = 0;
+        render_output_now(output);
+        return;
+    }
+    output->render_stats.render_delay_msec = delay_msec;
+
+    // Let clients start drawing now, so that their buffers arrive before the delayed render
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    viv_render_send_frame_done(output, &now);
+    output->render_schedule.frame_done_sent = true;
+
+    // Ignore further frame events until the delayed render is done
+    output->render_schedule.deferred = true;
+    wl_event_source_timer_update(output->render_schedule.timer, delay_msec);
+}
+
 static void output_damage_event(struct wl_listener *listener, void *data) {
     UNUSED(data);
     struct viv_output *output = wl_container_of(listener, output, damage_event);
@@ -115,8 +479,16 @@ static void output_damage_event(struct wl_listener *listener, void *data) {
 }
 
 static void output_present(struct wl_listener *listener, void *data) {
-    UNUSED(listener);
-    UNUSED(data);
+    struct viv_output *output = wl_container_of(listener, output, present);
+    struct wlr_output_event_present *event = data;
+
+    if (!event->presented || (event->when == NULL)) {
+        return;
+    }
+
+    // Remember when the last vblank was, to predict the next one
+    output->render_schedule.last_presentation_nsec = timespec_to_nsec(event->when);
+    output->render_schedule.refresh_nsec = event->refresh;
 }
 
 static void output_enable(struct wl_listener *listener, void *data) {
@@ -130,6 +502,53 @@ static void output_mode(struct wl_listener *listener, void *data) {
     UNUSED(data);
     struct viv_output *output = wl_container_of(listener, output, mode);
     wlr_log(WLR_INFO, "Output \"%s\" event: mode", output->wlr_output->name);
+
+    // Mirrors fit the output to themselves, so the whole fit changes with its size
+    struct viv_output *mirror;
+    wl_list_for_each(mirror, &output->server->mirror_outputs, link) {
+        if (mirror->mirror.source == output) {
+            viv_output_damage(mirror);
+        }
+    }
+}
+
+/// Let go of the buffer kept for mirrors, and the texture made from it
+static void release_mirror_buffer(struct viv_output *output) {
+    if (output->mirror.texture) {
+        wlr_texture_destroy(output->mirror.texture);
+        output->mirror.texture = NULL;
+    }
+    if (output->mirror.buffer) {
+        wlr_buffer_unlock(output->mirror.buffer);
+        output->mirror.buffer = NULL;
+    }
+}
+
+/// Keep hold of each buffer the output commits while it is mirrored, for its mirrors to
+/// show, and damage the mirrors where the buffer changed
+static void output_commit(struct wl_listener *listener, void *data) {
+    struct viv_output *output = wl_container_of(listener, output, mirror.commit);
+    struct wlr_output_event_commit *event = data;
+
+    if (!(event->committed & WLR_OUTPUT_STATE_BUFFER) || (event->buffer == NULL)) {
+        return;
+    }
+
+    release_mirror_buffer(output);
+    if (!output_is_mirrored(output)) {
+        return;
+    }
+    output->mirror.buffer = wlr_buffer_lock(event->buffer);
+
+    // Only frames committed through viv_output_commit have known damage, any others (e.g.
+    // direct scanout) may have changed everything
+    pixman_region32_t *damage = output->mirror.has_frame_damage ? &output->mirror.frame_damage : NULL;
+    struct viv_output *mirror;
+    wl_list_for_each(mirror, &output->server->mirror_outputs, link) {
+        if (mirror->mirror.source == output) {
+            viv_output_damage_mirror(mirror, damage);
+        }
+    }
 }
 
 static void output_destroy(struct wl_listener *listener, void *data) {
@@ -145,6 +564,22 @@ static void output_destroy(struct wl_listener *listener, void *data) {
     wl_list_remove(&output->enable.link);
     wl_list_remove(&output->mode.link);
     wl_list_remove(&output->destroy.link);
+    wl_list_remove(&output->mirror.commit.link);
+
+    release_mirror_buffer(output);
+    pixman_region32_fini(&output->mirror.frame_damage);
+    viv_geometry_scratch_fini(&output->geometry_scratch);
+
+    wl_event_source_remove(output->render_schedule.timer);
+    wl_event_source_remove(output->powered_off_timer);
+    wl_event_source_remove(output->idle_refresh.timer);
+
+    viv_render_output_state_fini(output);
+#ifdef SCENE_RENDERER
+    if (!output->mirror.is_mirror) {
+        viv_scene_output_fini(output);
+    }
+#endif
 
     free(output);
 }
@@ -247,18 +682,77 @@ void viv_output_display_workspace(struct viv_output *output, struct viv_workspac
     viv_cursor_reset_focus(workspace->server, (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000);
 }
 
+struct viv_output_config *viv_output_find_config(struct viv_server *server, struct wlr_output *wlr_output) {
+    struct viv_output_config *output_configs = server->config->output_configs;
+    if (!output_configs) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < MAX_NUM_OUTPUT_CONFIGS; i++) {
+        struct viv_output_config *config = &output_configs[i];
+        if (strlen(config->name) == 0) {
+            break;
+        }
+        if (strcmp(wlr_output->name, config->name) == 0) {
+            return config;
+        }
+    }
+    return NULL;
+}
+
 void viv_output_init(struct viv_output *output, struct viv_server *server, struct wlr_output *wlr_output) {
     wl_list_init(&output->layer_views);
 
 	output->wlr_output = wlr_output;
 	output->server = server;
 
+    output->config = viv_output_find_config(server, wlr_output);
+    output->mirror.is_mirror = (output->config && (strlen(output->config->mirror) > 0));
+    pixman_region32_init(&output->mirror.frame_damage);
+
+    output->reduced_render.scale = 1;
+    if (output->config && (output->config->render_scale != 1) && !output->mirror.is_mirror) {
+#ifdef SCENE_RENDERER
+        wlr_log(WLR_ERROR, "Output \"%s\": render-scale is not supported by the scene renderer, ignoring it",
+                wlr_output->name);
+#else
+        wlr_log(WLR_INFO, "Output \"%s\": compositing at render scale %f", wlr_output->name,
+                output->config->render_scale);
+        output->reduced_render.scale = output->config->render_scale;
+#endif
+    }
+
+    viv_render_output_state_init(output);
+
     output->excluded_margin.top = 0;
     output->excluded_margin.bottom = 0;
     output->excluded_margin.left = 0;
     output->excluded_margin.right = 0;
 
     output->damage = wlr_output_damage_create(output->wlr_output);
+#ifdef SCENE_RENDERER
+    // Mirrors copy their source's frames, rather than drawing the scene
+    if (!output->mirror.is_mirror) {
+        viv_scene_output_init(output);
+    }
+#endif
+
+    struct wl_event_loop *event_loop = wl_display_get_event_loop(server->wl_display);
+    output->render_schedule.timer = wl_event_loop_add_timer(event_loop, handle_render_timer, output);
+    CHECK_ALLOCATION(output->render_schedule.timer);
+    output->powered_off_timer = wl_event_loop_add_timer(event_loop, handle_powered_off_timer, output);
+    CHECK_ALLOCATION(output->powered_off_timer);
+    output->idle_refresh.timer = wl_event_loop_add_timer(event_loop, handle_idle_refresh_timer, output);
+    CHECK_ALLOCATION(output->idle_refresh.timer);
+
+    // Mirrors follow their source's frames, so only the source needs to idle
+    if (output->config && (output->config->idle_refresh_rate > 0) && !output->mirror.is_mirror) {
+        output->idle_refresh.refresh = (int32_t)(output->config->idle_refresh_rate * 1000 + 0.5);
+        int timeout_msec = output->config->idle_refresh_timeout * 1000;
+        output->idle_refresh.timeout_msec = (timeout_msec > 0) ? timeout_msec : 1;
+        output->idle_refresh.last_activity_msec = get_monotonic_msec();
+        wl_event_source_timer_update(output->idle_refresh.timer, output->idle_refresh.timeout_msec);
+    }
 
 	output->frame.notify = output_frame;
 	wl_signal_add(&output->damage->events.frame, &output->frame);
@@ -273,12 +767,52 @@ void viv_output_init(struct viv_output *output, struct viv_server *server, struc
 	wl_signal_add(&output->wlr_output->events.mode, &output->mode);
 	output->destroy.notify = output_destroy;
 	wl_signal_add(&output->wlr_output->events.destroy, &output->destroy);
+    output->mirror.commit.notify = output_commit;
+    wl_signal_add(&output->wlr_output->events.commit, &output->mirror.commit);
 
     wlr_log(WLR_INFO, "New output width width %d, height %d", wlr_output->width, wlr_output->height);
 
     start_using_output(output);
 }
 
+void viv_output_set_powered(struct viv_output *output, bool powered) {
+    if (output->powered_off == !powered) {
+        return;
+    }
+    wlr_log(WLR_INFO, "Output \"%s\" powered %s", output->wlr_output->name, powered ? "on" : "off");
+    output->powered_off = !powered;
+
+    if (!powered) {
+        // Drop any delayed render, and start pacing clients from the slow timer instead
+        wl_event_source_timer_update(output->render_schedule.timer, 0);
+        output->render_schedule.deferred = false;
+        output->render_schedule.frame_done_sent = false;
+        wl_event_source_timer_update(output->powered_off_timer, get_powered_off_frame_interval_msec(output));
+        return;
+    }
+
+    wl_event_source_timer_update(output->powered_off_timer, 0);
+
+    // Layouts were left alone while nothing could be seen, so catch up before drawing
+    if (output->current_workspace) {
+        viv_output_do_layout_if_necessary(output);
+    }
+    viv_output_damage(output);
+}
+
+void viv_output_notify_activity(struct viv_output *output) {
+    if (!output->idle_refresh.refresh) {
+        return;
+    }
+    output->idle_refresh.last_activity_msec = get_monotonic_msec();
+
+    if (output->idle_refresh.downclocked && !output->idle_refresh.activity_pending) {
+        // The refresh rate is restored from the next frame event
+        output->idle_refresh.activity_pending = true;
+        wlr_output_schedule_frame(output->wlr_output);
+    }
+}
+
 void viv_output_do_layout_if_necessary(struct viv_output *output) {
     struct viv_workspace *workspace = output->current_workspace;
     if (!(output->needs_layout | workspace->needs_layout)) {
@@ -294,55 +828,132 @@ void viv_output_damage(struct viv_output *output) {
         wlr_log(WLR_ERROR, "Tried to damage NULL output");
         return;
     }
+    if (output->powered_off) {
+        // The whole output is damaged when it is powered on again
+        return;
+    }
     wlr_output_damage_add_whole(output->damage);
+    viv_output_notify_activity(output);
 }
 
-void viv_output_damage_layout_coords_box(struct viv_output *output, struct wlr_box *box) {
-    struct wlr_box scaled_box;
-    memcpy(&scaled_box, box, sizeof(struct wlr_box));
-
-    double lx = 0, ly = 0;
-    wlr_output_layout_output_coords(output->server->output_layout, output->wlr_output, &lx, &ly);
+/// Get the offset that converts layout coordinates to unscaled output-local coordinates
+static void get_output_offset(struct viv_output *output, double *ox, double *oy) {
+    *ox = 0;
+    *oy = 0;
+    wlr_output_layout_output_coords(output->server->output_layout, output->wlr_output, ox, oy);
+}
 
-    scaled_box.x += lx;
-    scaled_box.y += ly;
+void viv_output_damage_layout_coords_box(struct viv_output *output, struct wlr_box *box) {
+    if (output->powered_off) {
+        return;
+    }
 
-    float scale = output->wlr_output->scale;
+    double ox, oy;
+    get_output_offset(output, &ox, &oy);
 
-    // TODO: Can we just round these rather than floor/ceil? Need to think through how
-    // scaling actually works out on different outputs
-    scaled_box.x = floor(scaled_box.x * scale);
-    scaled_box.y = floor(scaled_box.y * scale);
-    scaled_box.width = ceil((scaled_box.x + scaled_box.width) * scale) - floor(scaled_box.x * scale);
-    scaled_box.height = ceil((scaled_box.y + scaled_box.height) * scale) - floor(scaled_box.y * scale);
+    // Round outwards so that the damage covers every pixel the box is drawn to
+    struct wlr_box scaled_box;
+    viv_geometry_layout_box_to_output_box(&scaled_box, box, ox, oy, output->wlr_output->scale,
+                                          VIV_GEOMETRY_ROUND_OUTWARD);
 
     wlr_output_damage_add_box(output->damage, &scaled_box);
+    if ((scaled_box.width > 0) && (scaled_box.height > 0)) {
+        viv_output_notify_activity(output);
+    }
 }
 
 void viv_output_damage_layout_coords_region(struct viv_output *output, pixman_region32_t *damage) {
-    double lx = 0, ly = 0;
-    wlr_output_layout_output_coords(output->server->output_layout, output->wlr_output, &lx, &ly);
+    if (output->powered_off) {
+        return;
+    }
 
-    // Shift to output coords to apply damage
-    pixman_region32_translate(damage, lx, ly);
+    pixman_region32_t output_damage;
+    pixman_region32_init(&output_damage);
+    viv_output_layout_coords_region_to_output_coords(output, &output_damage, damage, VIV_GEOMETRY_ROUND_OUTWARD);
 
-    wlr_output_damage_add(output->damage, damage);
+    wlr_output_damage_add(output->damage, &output_damage);
+    if (pixman_region32_not_empty(&output_damage)) {
+        viv_output_notify_activity(output);
+    }
 
-    // Shift back to avoid permanently changing the damage
-    pixman_region32_translate(damage, -lx, -ly);
+    pixman_region32_fini(&output_damage);
 }
 
 void viv_output_layout_coords_box_to_output_coords(struct viv_output *output, struct wlr_box *geo_box) {
-    double lx = 0, ly = 0;
-    wlr_output_layout_output_coords(output->server->output_layout, output->wlr_output, &lx, &ly);
-    geo_box->x += lx;
-    geo_box->y += ly;
+    double ox, oy;
+    get_output_offset(output, &ox, &oy);
+    viv_geometry_layout_box_to_output_box(geo_box, geo_box, ox, oy, output->wlr_output->scale,
+                                          VIV_GEOMETRY_ROUND_NEAREST);
+}
+
+void viv_output_layout_coords_region_to_output_coords(struct viv_output *output, pixman_region32_t *dst, pixman_region32_t *src,
+                                                      enum viv_geometry_rounding rounding) {
+    double ox, oy;
+    get_output_offset(output, &ox, &oy);
+    viv_geometry_layout_region_to_output_region(dst, src, ox, oy, output->wlr_output->scale, rounding,
+                                                &output->geometry_scratch);
+}
+
+bool viv_output_commit(struct viv_output *output, pixman_region32_t *damage) {
+    output->mirror.has_frame_damage = true;
+    pixman_region32_copy(&output->mirror.frame_damage, damage);
+
+    bool success = wlr_output_commit(output->wlr_output);
+
+    output->mirror.has_frame_damage = false;
+    return success;
+}
+
+void viv_output_get_mirror_box(struct viv_output *output, struct wlr_box *box) {
+    struct viv_output *source = output->mirror.source;
+    int width, height, source_width, source_height;
+    wlr_output_transformed_resolution(output->wlr_output, &width, &height);
+    wlr_output_transformed_resolution(source->wlr_output, &source_width, &source_height);
+
+    // Keep the source's aspect ratio, leaving bars along two of the edges if it differs
+    viv_geometry_fit_box(box, source_width, source_height, width, height, VIV_GEOMETRY_FIT_FIT);
+}
+
+void viv_output_damage_mirror(struct viv_output *output, pixman_region32_t *source_damage) {
+    if (output->powered_off) {
+        return;
+    }
+    if (source_damage == NULL) {
+        viv_output_damage(output);
+        return;
+    }
+
+    struct viv_output *source = output->mirror.source;
+    struct wlr_box box;
+    viv_output_get_mirror_box(output, &box);
+    int source_width, source_height;
+    wlr_output_transformed_resolution(source->wlr_output, &source_width, &source_height);
+    float scale = (float)box.width / source_width;
+
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+    if (scale == 1) {
+        pixman_region32_copy(&damage, source_damage);
+        pixman_region32_translate(&damage, box.x, box.y);
+    } else {
+        // Scaling blends each source pixel into the mirror pixels around it, so the mirror
+        // changes one source pixel beyond the source's damage
+        pixman_region32_t expanded_damage;
+        pixman_region32_init(&expanded_damage);
+        wlr_region_expand(&expanded_damage, source_damage, 1);
+        viv_geometry_layout_region_to_output_region(&damage, &expanded_damage, box.x / scale, box.y / scale, scale,
+                                                    VIV_GEOMETRY_ROUND_OUTWARD, &output->geometry_scratch);
+        pixman_region32_fini(&expanded_damage);
+    }
+    wlr_output_damage_add(output->damage, &damage);
+    pixman_region32_fini(&damage);
 }
 
 void viv_output_mark_for_relayout(struct viv_output *output) {
     if (output) {
         // The layout will be applied after the next frame
         output->needs_layout = true;
+        viv_render_invalidate_entries(output->server);
         viv_output_damage(output);
     } else {
         wlr_log(WLR_ERROR, "Tried to mark NULL output for relayout");
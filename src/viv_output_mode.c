@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "viv_output_mode.h"
+
+/// Get the mode the output prefers, or its first mode if it doesn't say, or NULL if it
+/// advertises none
+static struct wlr_output_mode *find_preferred_mode(struct wl_list *modes) {
+    if (wl_list_empty(modes)) {
+        return NULL;
+    }
+
+    struct wlr_output_mode *mode;
+    wl_list_for_each(mode, modes, link) {
+        if (mode->preferred) {
+            return mode;
+        }
+    }
+    return wl_container_of(modes->next, mode, link);
+}
+
+/// Get the advertised mode at the given size whose refresh rate is nearest to refresh,
+/// or the fastest at that size if refresh is 0, ignoring any at or above max_refresh
+/// unless it is 0. Returns NULL if no mode fits.
+static struct wlr_output_mode *find_mode_nearest_refresh(struct wl_list *modes, int32_t width, int32_t height,
+                                                         int32_t refresh, int32_t max_refresh) {
+    struct wlr_output_mode *best = NULL;
+    struct wlr_output_mode *mode;
+    wl_list_for_each(mode, modes, link) {
+        if ((mode->width != width) || (mode->height != height)) {
+            continue;
+        }
+        if (max_refresh && (mode->refresh >= max_refresh)) {
+            continue;
+        }
+        if (!best) {
+            best = mode;
+        } else if (refresh == 0) {
+            if (mode->refresh > best->refresh) {
+                best = mode;
+            }
+        } else if (abs(mode->refresh - refresh) < abs(best->refresh - refresh)) {
+            best = mode;
+        }
+    }
+    return best;
+}
+
+static void choose_advertised_mode(struct viv_output_mode_choice *choice, struct wlr_output_mode *mode) {
+    choice->mode = mode;
+    choice->width = mode->width;
+    choice->height = mode->height;
+    choice->refresh = mode->refresh;
+}
+
+static void choose_custom_mode(struct viv_output_mode_choice *choice, int32_t width, int32_t height,
+                               int32_t refresh) {
+    choice->mode = NULL;
+    choice->width = width;
+    choice->height = height;
+    choice->refresh = refresh;
+}
+
+bool viv_output_mode_parse(const char *string, struct viv_output_mode_spec *spec) {
+    memset(spec, 0, sizeof(struct viv_output_mode_spec));
+
+    if (strcmp(string, "preferred") == 0) {
+        spec->kind = VIV_OUTPUT_MODE_PREFERRED;
+        return true;
+    }
+    if (strcmp(string, "highest-refresh") == 0) {
+        spec->kind = VIV_OUTPUT_MODE_HIGHEST_REFRESH;
+        return true;
+    }
+
+    int width, height;
+    int consumed = 0;
+    if ((sscanf(string, "%dx%d%n", &width, &height, &consumed) != 2) || (width <= 0) || (height <= 0)) {
+        return false;
+    }
+
+    const char *rest = string + consumed;
+    if (rest[0] == '@') {
+        char *end;
+        double refresh_hz = strtod(rest + 1, &end);
+        if ((end == rest + 1) || (*end != '\0') || (refresh_hz <= 0)) {
+            return false;
+        }
+        spec->refresh = (int32_t)(refresh_hz * 1000 + 0.5);
+    } else if (rest[0] != '\0') {
+        return false;
+    }
+
+    spec->kind = VIV_OUTPUT_MODE_SIZE;
+    spec->width = width;
+    spec->height = height;
+    return true;
+}
+
+bool viv_output_mode_choose(struct wl_list *modes, const struct viv_output_mode_spec *spec,
+                            struct viv_output_mode_choice *choice) {
+    struct wlr_output_mode *preferred = find_preferred_mode(modes);
+    struct wlr_output_mode *mode;
+
+    switch (spec->kind) {
+    case VIV_OUTPUT_MODE_PREFERRED:
+        if (!preferred) {
+            return false;
+        }
+        choose_advertised_mode(choice, preferred);
+        return true;
+    case VIV_OUTPUT_MODE_HIGHEST_REFRESH:
+        if (!preferred) {
+            return false;
+        }
+        mode = find_mode_nearest_refresh(modes, preferred->width, preferred->height, 0, 0);
+        choose_advertised_mode(choice, mode);
+        return true;
+    case VIV_OUTPUT_MODE_SIZE:
+        mode = find_mode_nearest_refresh(modes, spec->width, spec->height, spec->refresh, 0);
+        if (mode) {
+            choose_advertised_mode(choice, mode);
+        } else {
+            choose_custom_mode(choice, spec->width, spec->height, spec->refresh);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool viv_output_mode_choose_idle(struct wl_list *modes, int32_t width, int32_t height,
+                                 int32_t current_refresh, int32_t idle_refresh,
+                                 struct viv_output_mode_choice *choice) {
+    if ((idle_refresh <= 0) || (current_refresh <= 0)) {
+        return false;
+    }
+
+    if (wl_list_empty(modes)) {
+        if (idle_refresh >= current_refresh) {
+            return false;
+        }
+        choose_custom_mode(choice, width, height, idle_refresh);
+        return true;
+    }
+
+    struct wlr_output_mode *mode = find_mode_nearest_refresh(modes, width, height, idle_refresh, current_refresh);
+    if (!mode) {
+        return false;
+    }
+    choose_advertised_mode(choice, mode);
+    return true;
+}
+
+void viv_output_mode_set(struct wlr_output *wlr_output, const struct viv_output_mode_choice *choice) {
+    if (choice->mode) {
+        wlr_output_set_mode(wlr_output, choice->mode);
+    } else {
+        wlr_output_set_custom_mode(wlr_output, choice->width, choice->height, choice->refresh);
+    }
+}
@@ -1,10 +1,20 @@
+#include <drm_fourcc.h>
+#include <math.h>
+#include <stdlib.h>
 #include <time.h>
 
+#include <wlr/render/allocator.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/render/pixman.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_layer_shell_v1.h>
 #include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_presentation_time.h>
 #include <wlr/util/region.h>
 #include <wlr/xwayland.h>
 #include <wayland-util.h>
@@ -12,103 +22,314 @@
 #include <pixman-1/pixman.h>
 
 #include "viv_types.h"
+#include "viv_background.h"
 #include "viv_output.h"
+#include "viv_render.h"
 #include "viv_server.h"
 #include "viv_view.h"
 
 #define MAX(A, B) (A > B ? A : B)
 
+#define NUM_SCRATCH_REGIONS (sizeof(struct viv_render_scratch) / sizeof(pixman_region32_t))
+
+#define NSEC_PER_SEC 1000000000
+
+/// How many whole frames the auto damage tracking mode draws because partial frames were
+/// measured to be no faster, before measuring a partial frame again
+#define AUTO_DAMAGE_PROBE_INTERVAL 120
+
+/// State shared by everything drawn during a single call to viv_render_output, worked out
+/// once at the start of the frame. When the output has a reduced render scale, it is first
+/// composited into its reduced buffer, whose pixels are then what "output coordinates"
+/// refer to, and only afterwards drawn onto the output in a frame of its own.
+struct viv_render_frame {
+    struct viv_output *output;
+    struct wlr_renderer *renderer;
+    struct timespec when;
+    double ox;  // offset from layout coordinates to output coordinates
+    double oy;
+    int transformed_width;  // frame resolution, after applying the output's transform
+    int transformed_height;
+    enum wl_output_transform transform;  // transform from output coordinates to the buffer's
+    float projection[9];  // projection matrix for drawing to the buffer
+    pixman_region32_t *damage;  // the region being redrawn this frame, in output coordinates
+    struct viv_render_scratch *scratch;
+    pixman_image_t *pixman_image;  // the output's buffer, if it can be drawn to directly with pixman
+};
+
 /* Used to move all of the data necessary to render a surface from the top-level
  * frame handler to the per-surface render function. */
-// TODO: should this be internal to viv_render.c?
 struct viv_render_data {
-    struct wlr_output *output;
-    struct wlr_renderer *renderer;
+    struct viv_render_frame *frame;
     struct viv_view *view;
-    struct timespec *when;
     bool limit_render_count;
     int sx;
     int sy;
-    pixman_region32_t *damage;
     pixman_region32_t *surface_bounds;  // the actual bounds on the surface outside which it cannot draw
+    pixman_region32_t *occluded;  // region hidden by opaque surfaces drawn later, if any
+    bool is_primary_output;  // the frame's output sends the client frame callbacks and presentation feedback
 };
 
-static void render_surface(struct wlr_surface *surface, int sx, int sy, void *data) {
-    /* This function is called for every surface that needs to be rendered. */
-    struct viv_render_data *rdata = data;
+/// A view or layer view to be drawn this frame, along with the part of the output that
+/// will be covered by opaque surfaces drawn on top of it
+struct viv_render_entry {
+    struct viv_view *view;
+    struct viv_layer_view *layer_view;
+    pixman_region32_t occluded;
+    bool hidden;  // the view is tiled and entirely covered by opaque content above it, so it isn't drawn
+};
 
-    sx += rdata->sx;
-    sy += rdata->sy;
+/// Get the offset that converts layout coordinates to unscaled output-local coordinates
+static void get_output_offset(struct viv_output *output, double *ox, double *oy) {
+    *ox = 0;
+    *oy = 0;
+    wlr_output_layout_output_coords(output->server->output_layout, output->wlr_output, ox, oy);
+}
 
-    struct viv_view *view = rdata->view;
-    struct wlr_output *output = rdata->output;
-    struct wlr_renderer *renderer = rdata->renderer;
-    pixman_region32_t *damage = rdata->damage;
+/// Whether the output is composited at a reduced resolution and then upscaled
+static bool output_has_reduced_render(struct viv_output *output) {
+    return output->reduced_render.scale != 1;
+}
+
+/// Get the scale from layout coordinates to the output coordinates that the output is
+/// composited in, i.e. the output's own scale reduced by its render scale
+static float get_render_scale(struct viv_output *output) {
+    return output->wlr_output->scale * output->reduced_render.scale;
+}
+
+/// Get the resolution, after applying the output's transform, that the output is
+/// composited at
+static void get_render_resolution(struct viv_output *output, int *width, int *height) {
+    wlr_output_transformed_resolution(output->wlr_output, width, height);
+    if (output_has_reduced_render(output)) {
+        *width = ceil(*width * output->reduced_render.scale);
+        *height = ceil(*height * output->reduced_render.scale);
+    }
+}
+
+/// Convert a box from layout coordinates to the output coordinates that the output is
+/// composited in, rounded to the nearest pixel like everything that is drawn
+static void layout_box_to_render_box(struct viv_output *output, struct wlr_box *box) {
+    double ox, oy;
+    get_output_offset(output, &ox, &oy);
+    viv_geometry_layout_box_to_output_box(box, box, ox, oy, get_render_scale(output), VIV_GEOMETRY_ROUND_NEAREST);
+}
+
+/// Convert a region from layout coordinates to the output coordinates that the output is
+/// composited in
+static void layout_region_to_render_region(struct viv_output *output, pixman_region32_t *dst, pixman_region32_t *src,
+                                           enum viv_geometry_rounding rounding) {
+    double ox, oy;
+    get_output_offset(output, &ox, &oy);
+    viv_geometry_layout_region_to_output_region(dst, src, ox, oy, get_render_scale(output), rounding,
+                                                &output->geometry_scratch);
+}
+
+/// Get the box, in output coordinates at the given scale, of the given surface when drawn
+/// at the given layout coordinates. ox and oy must be the output's offset from
+/// get_output_offset.
+static void get_surface_output_box(struct wlr_surface *surface, float scale, double ox, double oy,
+                                   int lx, int ly, struct wlr_box *box) {
+    struct wlr_box layout_box = {
+        .x = lx,
+        .y = ly,
+        .width = surface->current.width,
+        .height = surface->current.height,
+    };
+    viv_geometry_layout_box_to_output_box(box, &layout_box, ox, oy, scale, VIV_GEOMETRY_ROUND_NEAREST);
+}
+
+/// Limit drawing to the given box, in output coordinates. The renderer's scissor box is in
+/// buffer coordinates, so this undoes the frame's transform.
+static void scissor_output_box(struct viv_render_frame *frame, struct wlr_box *box) {
+    enum wl_output_transform transform = wlr_output_transform_invert(frame->transform);
+    struct wlr_box buffer_box;
+    wlr_box_transform(&buffer_box, box, transform, frame->transformed_width, frame->transformed_height);
+    wlr_renderer_scissor(frame->renderer, &buffer_box);
+}
+
+/// Tell the output which part of its buffer changed since the last frame, which backends
+/// and capture clients (e.g. screencopy's copy_with_damage) use to skip everything else.
+/// The output's damage is tracked in output coordinates, but is set in buffer coordinates.
+static void set_output_frame_damage(struct viv_output *output) {
+    int width, height;
+    wlr_output_transformed_resolution(output->wlr_output, &width, &height);
+    pixman_region32_t *frame_damage = &output->render_scratch.frame_damage;
+    enum wl_output_transform transform = wlr_output_transform_invert(output->wlr_output->transform);
+    wlr_region_transform(frame_damage, &output->damage->current, transform, width, height);
+    wlr_output_set_damage(output->wlr_output, frame_damage);
+}
+
+/// Whether the region's storage has been allocated since its data pointer was old_data.
+/// Note that pixman frees the storage of any region that becomes a single rectangle.
+static bool region_was_allocated(pixman_region32_t *region, pixman_region32_data_t *old_data) {
+    return (region->data != old_data) && (region->data != NULL) && (region->data->size > 0);
+}
+
+static void swap_regions(pixman_region32_t **a, pixman_region32_t **b) {
+    pixman_region32_t *tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+/// Fill the given rects, in output coordinates, straight into the output's buffer with a
+/// single pixman call. The pixman renderer would instead composite a solid image over the
+/// whole buffer once for each rect, clipped to that rect.
+static void fill_rects_with_pixman(struct viv_render_frame *frame, pixman_op_t op, const float colour[static 4],
+                                   pixman_box32_t *rects, int num_rects) {
+    pixman_color_t pixman_colour = {
+        .red = colour[0] * 0xffff,
+        .green = colour[1] * 0xffff,
+        .blue = colour[2] * 0xffff,
+        .alpha = colour[3] * 0xffff,
+    };
+    // Undo any scissoring left by the renderer, as every rect is already within the damage
+    pixman_image_set_clip_region32(frame->pixman_image, NULL);
+    pixman_image_fill_boxes(op, frame->pixman_image, &pixman_colour, num_rects, rects);
+}
+
+/// Get the pixman operator that draws the given colour like wlr_render_rect
+static pixman_op_t get_rect_pixman_op(const float colour[static 4]) {
+    return (colour[3] < 1) ? PIXMAN_OP_OVER : PIXMAN_OP_SRC;
+}
+
+/// Draw the texture straight into the output's buffer with a single pixman call, clipped to
+/// the given damage. The pixman renderer would instead transform and composite the whole
+/// texture once for each damage rect. Only textures drawn untransformed at their own size
+/// are handled, returns false without drawing anything otherwise.
+static bool render_texture_with_pixman(struct viv_render_frame *frame, struct wlr_texture *texture,
+                                       struct wlr_fbox *src_box, struct wlr_box *box,
+                                       enum wl_output_transform texture_transform, pixman_region32_t *damage) {
+    if ((texture_transform != WL_OUTPUT_TRANSFORM_NORMAL) ||
+        (box->width != (int)texture->width) || (box->height != (int)texture->height) ||
+        (src_box->x != 0) || (src_box->y != 0) ||
+        (src_box->width != texture->width) || (src_box->height != texture->height)) {
+        return false;
+    }
+
+    pixman_image_t *src = wlr_pixman_texture_get_image(texture);
+    if (!src) {
+        return false;
+    }
+
+    // Textures without an alpha channel can be copied rather than blended
+    pixman_op_t op = (PIXMAN_FORMAT_A(pixman_image_get_format(src)) == 0) ? PIXMAN_OP_SRC : PIXMAN_OP_OVER;
+
+    pixman_image_set_clip_region32(frame->pixman_image, damage);
+    pixman_image_composite32(op, src, NULL, frame->pixman_image,
+                             0, 0, 0, 0, box->x, box->y, box->width, box->height);
+    pixman_image_set_clip_region32(frame->pixman_image, NULL);
+    return true;
+}
+
+/// Draw the texture into the given box, in output coordinates, limited to the damaged parts
+/// of the box that are within the render data's surface bounds (if any) and not occluded
+static void render_texture(struct viv_render_data *rdata, struct wlr_texture *texture, struct wlr_fbox *src_box,
+                           struct wlr_box *box, enum wl_output_transform texture_transform) {
+    struct viv_render_frame *frame = rdata->frame;
+    struct wlr_renderer *renderer = frame->renderer;
 
     // Generate a damaged area worth drawing from the intersection of the supplied surface
-    // bounds (if any) and the damaged region
-    pixman_region32_t applied_surface_bounds;
-    pixman_region32_init(&applied_surface_bounds);
-    pixman_region32_union(&applied_surface_bounds, &applied_surface_bounds, damage);
+    // bounds (if any), the damaged region and the surface itself. Each step writes to the
+    // other scratch region, as pixman can only reuse storage when not operating in place.
+    pixman_region32_t *surface_damage = &frame->scratch->surface_damage;
+    pixman_region32_t *spare_damage = &frame->scratch->surface_damage_spare;
+    pixman_region32_intersect_rect(surface_damage, frame->damage, box->x, box->y, box->width, box->height);
     if (rdata->surface_bounds) {
-        pixman_region32_intersect(&applied_surface_bounds, &applied_surface_bounds, rdata->surface_bounds);
+        pixman_region32_intersect(spare_damage, surface_damage, rdata->surface_bounds);
+        swap_regions(&surface_damage, &spare_damage);
     }
 
-    struct wlr_texture *texture = wlr_surface_get_texture(surface);
-    if (texture == NULL) {
-        return;
+    // Skip anything that will be hidden by opaque surfaces drawn later
+    if (rdata->occluded && pixman_region32_not_empty(surface_damage)) {
+        pixman_region32_subtract(spare_damage, surface_damage, rdata->occluded);
+        swap_regions(&surface_damage, &spare_damage);
+        if (!pixman_region32_not_empty(surface_damage)) {
+            frame->output->render_stats.culled_surfaces++;
+        }
     }
 
-    // Translate to output-local coordinates
-    double ox = 0, oy = 0;
-    wlr_output_layout_output_coords(
-            view->server->output_layout, output, &ox, &oy);
-    ox += view->x + sx;
-    oy += view->y + sy;
+    if (!pixman_region32_not_empty(surface_damage)) {
+        return;
+    }
 
-    // Apply output scale factor
-    // TODO: this needs more work elsewhere to actually work
-    struct wlr_box box = {
-        .x = ox * output->scale,
-        .y = oy * output->scale,
-        .width = surface->current.width * output->scale,
-        .height = surface->current.height * output->scale,
-    };
+    if (frame->pixman_image &&
+        render_texture_with_pixman(frame, texture, src_box, box, texture_transform, surface_damage)) {
+        return;
+    }
 
     float matrix[9];
-    enum wl_output_transform transform =
-        wlr_output_transform_invert(surface->current.transform);
-    wlr_matrix_project_box(matrix, &box, transform, 0,
-        output->transform_matrix);
+    enum wl_output_transform transform = wlr_output_transform_invert(texture_transform);
+    wlr_matrix_project_box(matrix, box, transform, 0, frame->projection);
 
-    if (pixman_region32_not_empty(&applied_surface_bounds)) {
-        int num_rects;
-        pixman_box32_t *rects = pixman_region32_rectangles(&applied_surface_bounds, &num_rects);
-        for (int i = 0; i < num_rects; i++) {
-            pixman_box32_t rect = rects[i];
-            struct wlr_box box = {
-                .x = rect.x1,
-                .y = rect.y1,
-                .width = rect.x2 - rect.x1,
-                .height = rect.y2 - rect.y1,
-            };
-            int output_width, output_height;
-            wlr_output_transformed_resolution(output, &output_width, &output_height);
-            wlr_box_transform(&box, &box, transform, output_width, output_height);
-            wlr_renderer_scissor(renderer, &box);
+    int num_rects;
+    pixman_box32_t *rects = pixman_region32_rectangles(surface_damage, &num_rects);
+    for (int i = 0; i < num_rects; i++) {
+        pixman_box32_t rect = rects[i];
+        struct wlr_box rect_box = {
+            .x = rect.x1,
+            .y = rect.y1,
+            .width = rect.x2 - rect.x1,
+            .height = rect.y2 - rect.y1,
+        };
+        scissor_output_box(frame, &rect_box);
 
-            /* This takes our matrix, the texture, and an alpha, and performs the actual
-            * rendering on the GPU. */
-            wlr_render_texture_with_matrix(rdata->renderer, texture, matrix, 1);
-        }
+        /* This takes our matrix, the texture, and an alpha, and performs the actual
+        * rendering on the GPU. */
+        wlr_render_subtexture_with_matrix(renderer, texture, src_box, matrix, 1);
+    }
+}
+
+/// Let the surface's client know that the surface was drawn in the given box, in output
+/// coordinates
+static void send_surface_feedback(struct viv_render_frame *frame, struct wlr_surface *surface, struct wlr_box *box) {
+    // Surfaces on the output will be displayed when it commits, so the client should get
+    // presentation feedback from this output's next present event
+    struct wlr_box output_box = {
+        .width = frame->transformed_width,
+        .height = frame->transformed_height,
+    };
+    struct wlr_box intersection;
+    if (wlr_box_intersection(&intersection, &output_box, box)) {
+        wlr_presentation_surface_sampled_on_output(frame->output->server->presentation, surface, frame->output->wlr_output);
     }
 
     /* This lets the client know that we've displayed that frame and it can
      * prepare another one now if it likes. */
-    // TODO: Should be wlr_presentation_surface_sampled_on_output?
-    wlr_surface_send_frame_done(surface, rdata->when);
+    if (!frame->output->render_schedule.frame_done_sent) {
+        wlr_surface_send_frame_done(surface, &frame->when);
+    }
+}
+
+static void render_surface(struct wlr_surface *surface, int sx, int sy, void *data) {
+    /* This function is called for every surface that needs to be rendered. */
+    struct viv_render_data *rdata = data;
+    struct viv_render_frame *frame = rdata->frame;
+
+    sx += rdata->sx;
+    sy += rdata->sy;
+
+    struct viv_view *view = rdata->view;
+
+    struct wlr_texture *texture = wlr_surface_get_texture(surface);
+    if (texture == NULL) {
+        return;
+    }
+
+    struct wlr_box box;
+    get_surface_output_box(surface, get_render_scale(frame->output), frame->ox, frame->oy,
+                           view->x + sx, view->y + sy, &box);
+
+    // The surface size already accounts for any viewport destination size, but the part of
+    // the buffer to sample may have been cropped too
+    struct wlr_fbox src_box;
+    wlr_surface_get_buffer_source_box(surface, &src_box);
+
+    render_texture(rdata, texture, &src_box, &box, surface->current.transform);
 
-    pixman_region32_fini(&applied_surface_bounds);
+    if (rdata->is_primary_output) {
+        send_surface_feedback(frame, surface, &box);
+    }
 }
 
 static void popup_render_surface(struct wlr_surface *surface, int sx, int sy, void *data) {
@@ -119,20 +340,19 @@ static void popup_render_surface(struct wlr_surface *surface, int sx, int sy, vo
     wlr_surface_for_each_surface(surface, render_surface, rdata);
 }
 
-static void render_rect(struct wlr_box *box, struct viv_output *output, pixman_region32_t *damage, float colour[static 4]) {
-    struct wlr_output *wlr_output = output->wlr_output;
-    struct wlr_renderer *renderer = output->server->renderer;
-
-    // TODO: Need to translate box to output coords - -= output->lx etc.
+static void render_rect(struct viv_render_frame *frame, struct wlr_box *box, pixman_region32_t *damage, float colour[static 4]) {
+    struct wlr_renderer *renderer = frame->renderer;
 
-    pixman_region32_t box_region_damage;
-    pixman_region32_init(&box_region_damage);
-    pixman_region32_union_rect(&box_region_damage, &box_region_damage, box->x, box->y, box->width, box->height);
-    pixman_region32_intersect(&box_region_damage, &box_region_damage, damage);
+    pixman_region32_t *box_region_damage = &frame->scratch->rect_damage;
+    pixman_region32_intersect_rect(box_region_damage, damage, box->x, box->y, box->width, box->height);
 
-    if (pixman_region32_not_empty(&box_region_damage)) {
+    if (pixman_region32_not_empty(box_region_damage)) {
         int num_rects;
-        pixman_box32_t *rects = pixman_region32_rectangles(&box_region_damage, &num_rects);
+        pixman_box32_t *rects = pixman_region32_rectangles(box_region_damage, &num_rects);
+        if (frame->pixman_image) {
+            fill_rects_with_pixman(frame, get_rect_pixman_op(colour), colour, rects, num_rects);
+            return;
+        }
         for (int i = 0; i < num_rects; i++) {
             pixman_box32_t rect = rects[i];
             struct wlr_box rect_box = {
@@ -141,163 +361,412 @@ static void render_rect(struct wlr_box *box, struct viv_output *output, pixman_r
                 .width = rect.x2 - rect.x1,
                 .height = rect.y2 - rect.y1,
             };
-            wlr_renderer_scissor(renderer, &rect_box);
-            wlr_render_rect(renderer, box, colour, wlr_output->transform_matrix);
+            scissor_output_box(frame, &rect_box);
+            wlr_render_rect(renderer, box, colour, frame->projection);
         }
     }
-
-    pixman_region32_fini(&box_region_damage);
 }
 
 /// Fills the screen around the fullscreen view with black
-static void render_fullscreen_fill(struct viv_view *view, struct viv_output *output, pixman_region32_t *output_damage) {
+static void render_fullscreen_fill(struct viv_render_frame *frame, struct viv_view *view, pixman_region32_t *output_damage) {
+    struct viv_output *output = frame->output;
     float black[] = {0, 0, 0, 1};
     struct wlr_box box;
 
+    // The view's target box is in layout coords, but the fill is drawn in output coords
+    struct wlr_box view_box = view->target_box;
+    layout_box_to_render_box(output, &view_box);
+    int output_width = frame->transformed_width;
+    int output_height = frame->transformed_height;
+
     // top
     box.x = 0;
     box.y = 0;
-    box.width = output->wlr_output->width;
-    box.height = view->target_box.y;
+    box.width = output_width;
+    box.height = view_box.y;
     if (box.width > 0 && box.height > 0) {
-        render_rect(&box, output, output_damage, black);
+        render_rect(frame, &box, output_damage, black);
     }
 
     // left
     box.x = 0;
-    box.y = view->target_box.y;
-    box.width = view->target_box.x;
-    box.height = view->target_box.height;
+    box.y = view_box.y;
+    box.width = view_box.x;
+    box.height = view_box.height;
     if (box.width > 0 && box.height > 0) {
-        render_rect(&box, output, output_damage, black);
+        render_rect(frame, &box, output_damage, black);
     }
 
     // right
-    box.x = view->target_box.x + view->target_box.width;
-    box.y = view->target_box.y;
-    box.width = output->wlr_output->width - box.x;
-    box.height = view->target_box.height;
+    box.x = view_box.x + view_box.width;
+    box.y = view_box.y;
+    box.width = output_width - box.x;
+    box.height = view_box.height;
     if (box.width > 0 && box.height > 0) {
-        render_rect(&box, output, output_damage, black);
+        render_rect(frame, &box, output_damage, black);
     }
 
     // bottom
     box.x = 0;
-    box.y = view->target_box.y + view->target_box.height;
-    box.width = output->wlr_output->width;
-    box.height = output->wlr_output->height - box.y;
+    box.y = view_box.y + view_box.height;
+    box.width = output_width;
+    box.height = output_height - box.y;
     if (box.width > 0 && box.height > 0) {
-        render_rect(&box, output, output_damage, black);
+        render_rect(frame, &box, output_damage, black);
     }
 }
 
 /// Render the given view's borders, on the given output. The border will be the active
-/// colour if is_active is true, or otherwise the inactive colour.
-static void render_borders(struct viv_view *view, struct viv_output *output, pixman_region32_t *output_damage, bool is_active) {
-    struct viv_server *server = output->server;
-    int gap_width = server->config->gap_width;
-
-    double x = 0, y = 0;
-    wlr_output_layout_output_coords(server->output_layout, output->wlr_output, &x, &y);
-    x += view->target_box.x + gap_width;
-    y += view->target_box.y + gap_width;
-    int width = MAX(1, view->target_box.width - 2 * gap_width);
-    int height = MAX(1, view->target_box.height - 2 * gap_width);
+/// colour if is_active is true, or otherwise the inactive colour. The whole border ring is
+/// intersected with the damage at once, and each resulting rect is filled directly.
+static void render_borders(struct viv_render_frame *frame, struct viv_view *view, pixman_region32_t *output_damage, bool is_active) {
+    struct viv_server *server = frame->output->server;
+    struct wlr_renderer *renderer = frame->renderer;
     float *colour = (is_active ?
                      server->config->active_border_colour :
                      server->config->inactive_border_colour);
 
-    int line_width = server->config->border_width;
+    // Round like the view's surfaces, so that the border meets them without gaps or overlap
+    pixman_region32_t *border = &frame->scratch->border;
+    layout_region_to_render_region(frame->output, border, viv_view_get_border_region(view),
+                                   VIV_GEOMETRY_ROUND_NEAREST);
+
+    pixman_region32_t *border_damage = &frame->scratch->rect_damage;
+    pixman_region32_intersect(border_damage, border, output_damage);
+
+    int num_rects;
+    pixman_box32_t *rects = pixman_region32_rectangles(border_damage, &num_rects);
+    if (num_rects == 0) {
+        return;
+    }
+
+    if (frame->pixman_image) {
+        fill_rects_with_pixman(frame, get_rect_pixman_op(colour), colour, rects, num_rects);
+        return;
+    }
+
+    // Every rect lies within the damage, so no scissoring is needed
+    wlr_renderer_scissor(renderer, NULL);
+    for (int i = 0; i < num_rects; i++) {
+        pixman_box32_t rect = rects[i];
+        struct wlr_box rect_box = {
+            .x = rect.x1,
+            .y = rect.y1,
+            .width = rect.x2 - rect.x1,
+            .height = rect.y2 - rect.y1,
+        };
+        wlr_render_rect(renderer, &rect_box, colour, frame->projection);
+    }
+}
+
+/// Whether the output may be drawn in partial frames, redrawing only its damaged regions.
+/// Whole frames are cheap on a GPU, but the software renderer has to redraw every pixel,
+/// so it draws partial frames in the frame damage tracking mode too.
+static bool output_draws_partial_frames(struct viv_output *output) {
+    struct viv_server *server = output->server;
+    switch (server->config->damage_tracking_mode) {
+    case VIV_DAMAGE_TRACKING_FULL:
+    case VIV_DAMAGE_TRACKING_AUTO:
+        return true;
+    case VIV_DAMAGE_TRACKING_FRAME:
+        return server->software_renderer;
+    default:
+        return false;
+    }
+}
+
+/// Get the box outside which the main surfaces of the given view are not drawn, in output
+/// coordinates. Returns false if the view's surfaces are not clipped.
+static bool view_get_surface_clip_box(struct viv_view *view, struct viv_output *output, struct wlr_box *box) {
+    bool is_clipped = false;
+    switch (view->type) {
+    case VIV_VIEW_TYPE_XDG_SHELL:
+        // Only partial frames need clipping, but clip whenever they may be drawn so that
+        // nothing flickers when the auto mode switches between partial and whole frames
+        is_clipped = output_draws_partial_frames(output);
+        break;
+#ifdef XWAYLAND
+    case VIV_VIEW_TYPE_XWAYLAND:
+        is_clipped = true;
+        break;
+#endif
+    default:
+        UNREACHABLE();
+    }
+
+    if (is_clipped) {
+        memcpy(box, &view->target_box, sizeof(struct wlr_box));
+        layout_box_to_render_box(output, box);
+    }
+    return is_clipped;
+}
+
+/// Get the part of the frame's damage that will not be covered by opaque surfaces drawn
+/// later. The result is stored in the frame's scratch space, and is valid until the next
+/// call.
+static pixman_region32_t *get_visible_damage(struct viv_render_frame *frame, pixman_region32_t *occluded) {
+    pixman_region32_t *visible_damage = &frame->scratch->visible_damage;
+    if (occluded) {
+        pixman_region32_subtract(visible_damage, frame->damage, occluded);
+    } else {
+        pixman_region32_copy(visible_damage, frame->damage);
+    }
+    return visible_damage;
+}
+
+/// Data for walking the main surface tree of a view with a texture cache
+struct viv_texture_cache_data {
+    struct wlr_box bounds;  // bounds of the surfaces walked so far, in surface-local coords
+    size_t num_surfaces;
+    struct wlr_renderer *renderer;  // the remaining fields are only used when drawing
+    float scale;
+    float projection[9];
+};
+
+static void add_surface_to_cache_bounds(struct wlr_surface *surface, int sx, int sy, void *data) {
+    struct viv_texture_cache_data *cdata = data;
+
+    // Match render_surface, which skips surfaces without a buffer
+    if (wlr_surface_get_texture(surface) == NULL) {
+        return;
+    }
+
+    int x1 = sx;
+    int y1 = sy;
+    int x2 = sx + surface->current.width;
+    int y2 = sy + surface->current.height;
+    if (cdata->num_surfaces > 0) {
+        struct wlr_box *bounds = &cdata->bounds;
+        x1 = (bounds->x < x1) ? bounds->x : x1;
+        y1 = (bounds->y < y1) ? bounds->y : y1;
+        x2 = (bounds->x + bounds->width > x2) ? bounds->x + bounds->width : x2;
+        y2 = (bounds->y + bounds->height > y2) ? bounds->y + bounds->height : y2;
+    }
+    cdata->bounds.x = x1;
+    cdata->bounds.y = y1;
+    cdata->bounds.width = x2 - x1;
+    cdata->bounds.height = y2 - y1;
+    cdata->num_surfaces++;
+}
+
+static void draw_surface_to_cache(struct wlr_surface *surface, int sx, int sy, void *data) {
+    struct viv_texture_cache_data *cdata = data;
 
-    // TODO: account for scale factor
+    struct wlr_texture *texture = wlr_surface_get_texture(surface);
+    if (texture == NULL) {
+        return;
+    }
 
+    // Round like get_surface_output_box, treating the cache's origin as the output's
+    struct wlr_box layout_box = {
+        .x = sx,
+        .y = sy,
+        .width = surface->current.width,
+        .height = surface->current.height,
+    };
     struct wlr_box box;
+    viv_geometry_layout_box_to_output_box(&box, &layout_box, -cdata->bounds.x, -cdata->bounds.y, cdata->scale,
+                                          VIV_GEOMETRY_ROUND_NEAREST);
 
-    // bottom
-    box.x = x;
-    box.y = y;
-    box.width = width;
-    box.height = line_width;
-    render_rect(&box, output, output_damage, colour);
+    float matrix[9];
+    enum wl_output_transform transform = wlr_output_transform_invert(surface->current.transform);
+    wlr_matrix_project_box(matrix, &box, transform, 0, cdata->projection);
 
-    // top
-    box.x = x;
-    box.y = y + height - line_width;
-    box.width = width;
-    box.height = line_width;
-    render_rect(&box, output, output_damage, colour);
+    struct wlr_fbox src_box;
+    wlr_surface_get_buffer_source_box(surface, &src_box);
+    wlr_render_subtexture_with_matrix(cdata->renderer, texture, &src_box, matrix, 1);
+}
 
-    // left
-    box.x = x;
-    box.y = y;
-    box.width = line_width;
-    box.height = height;
-    render_rect(&box, output, output_damage, colour);
+/// Whether the view is made of enough surfaces for a texture cache to be worthwhile. If
+/// so, the bounds of its main surface tree are stored in cdata.
+static bool view_wants_texture_cache(struct viv_view *view, struct viv_texture_cache_data *cdata) {
+    if (!view->server->config->render.view_texture_cache ||
+        (view->type != VIV_VIEW_TYPE_XDG_SHELL) || !view->mapped) {
+        return false;
+    }
 
-    // right
-    box.x = x + width - line_width;
-    box.y = y;
-    box.width = line_width;
-    box.height = height;
-    render_rect(&box, output, output_damage, colour);
+    wlr_surface_for_each_surface(view->xdg_surface->surface, add_surface_to_cache_bounds, cdata);
+    return (cdata->num_surfaces > 1) && (cdata->bounds.width > 0) && (cdata->bounds.height > 0);
+}
 
+static void release_texture_cache(struct viv_view *view) {
+    if (view->texture_cache.texture) {
+        wlr_texture_destroy(view->texture_cache.texture);
+        view->texture_cache.texture = NULL;
+    }
+    if (view->texture_cache.buffer) {
+        wlr_buffer_drop(view->texture_cache.buffer);
+        view->texture_cache.buffer = NULL;
+    }
 }
 
-static void viv_render_xdg_view(struct wlr_renderer *renderer, struct viv_view *view, struct viv_output *output, pixman_region32_t *damage) {
-    if (!view->mapped) {
-        // Unmapped views don't need any further rendering
+static struct wlr_buffer *create_texture_cache_buffer(struct viv_server *server, int width, int height) {
+    // Every renderer can draw to ARGB8888, and an implicit modifier leaves the choice of
+    // layout to the allocator
+    struct wlr_drm_format *format = calloc(1, sizeof(struct wlr_drm_format) + sizeof(uint64_t));
+    CHECK_ALLOCATION(format);
+    format->format = DRM_FORMAT_ARGB8888;
+    format->len = 1;
+    format->capacity = 1;
+    format->modifiers[0] = DRM_FORMAT_MOD_INVALID;
+
+    struct wlr_buffer *buffer = wlr_allocator_create_buffer(server->allocator, width, height, format);
+    free(format);
+    return buffer;
+}
+
+/// Draw the view's main surface tree, whose bounds must already be in cdata, into its
+/// texture cache at the given scale. Returns false if the cache couldn't be drawn.
+static bool redraw_texture_cache(struct viv_view *view, struct viv_texture_cache_data *cdata, float scale) {
+    struct viv_server *server = view->server;
+    struct wlr_renderer *renderer = server->renderer;
+
+    struct wlr_box size_box = {
+        .width = cdata->bounds.width,
+        .height = cdata->bounds.height,
+    };
+    struct wlr_box buffer_box;
+    viv_geometry_layout_box_to_output_box(&buffer_box, &size_box, 0, 0, scale, VIV_GEOMETRY_ROUND_NEAREST);
+
+    struct wlr_buffer *buffer = view->texture_cache.buffer;
+    if (buffer && ((buffer->width != buffer_box.width) || (buffer->height != buffer_box.height))) {
+        release_texture_cache(view);
+        buffer = NULL;
+    }
+    if (buffer == NULL) {
+        buffer = create_texture_cache_buffer(server, buffer_box.width, buffer_box.height);
+        if (buffer == NULL) {
+            wlr_log(WLR_ERROR, "Failed to allocate a %dx%d texture cache for view at %p",
+                    buffer_box.width, buffer_box.height, view);
+            return false;
+        }
+        view->texture_cache.buffer = buffer;
+    }
+
+    if (!wlr_renderer_begin_with_buffer(renderer, buffer)) {
+        wlr_log(WLR_ERROR, "Failed to start drawing the texture cache for view at %p", view);
+        return false;
+    }
+    wlr_renderer_scissor(renderer, NULL);
+    wlr_renderer_clear(renderer, (float[]){0, 0, 0, 0});
+
+    cdata->renderer = renderer;
+    cdata->scale = scale;
+    wlr_matrix_projection(cdata->projection, buffer->width, buffer->height, WL_OUTPUT_TRANSFORM_NORMAL);
+    wlr_surface_for_each_surface(view->xdg_surface->surface, draw_surface_to_cache, cdata);
+
+    wlr_renderer_end(renderer);
+
+    // The renderer only picks up the buffer's new contents when a texture is made from it
+    if (view->texture_cache.texture) {
+        wlr_texture_destroy(view->texture_cache.texture);
+    }
+    view->texture_cache.texture = wlr_texture_from_buffer(renderer, buffer);
+    if (view->texture_cache.texture == NULL) {
+        wlr_log(WLR_ERROR, "Failed to make a texture from the texture cache for view at %p", view);
+        return false;
+    }
+
+    view->texture_cache.bounds = cdata->bounds;
+    view->texture_cache.scale = scale;
+    view->texture_cache.dirty = false;
+    return true;
+}
+
+static bool view_texture_cache_is_usable(struct viv_view *view, struct viv_output *output) {
+    return (view->server->config->render.view_texture_cache &&
+            (view->texture_cache.texture != NULL) &&
+            !view->texture_cache.dirty &&
+            (view->texture_cache.scale == get_render_scale(output)));
+}
+
+static void send_cached_surface_feedback(struct wlr_surface *surface, int sx, int sy, void *data) {
+    struct viv_render_data *rdata = data;
+    struct viv_render_frame *frame = rdata->frame;
+
+    // Match render_surface, which skips surfaces without a buffer
+    if (wlr_surface_get_texture(surface) == NULL) {
         return;
     }
 
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct wlr_box box;
+    get_surface_output_box(surface, get_render_scale(frame->output), frame->ox, frame->oy,
+                           rdata->view->x + sx, rdata->view->y + sy, &box);
+    send_surface_feedback(frame, surface, &box);
+}
 
-    // Note this renders both the toplevel and any popups
-    struct wlr_box *target_geometry = &view->target_box;
+/// Draw the view's main surface tree from its texture cache, which must be usable
+static void render_view_texture_cache(struct viv_render_data *rdata) {
+    struct viv_view *view = rdata->view;
+    struct wlr_buffer *buffer = view->texture_cache.buffer;
+
+    struct wlr_box box = view->texture_cache.bounds;
+    box.x += view->x;
+    box.y += view->y;
+    layout_box_to_render_box(rdata->frame->output, &box);
+
+    struct wlr_fbox src_box = {
+        .width = buffer->width,
+        .height = buffer->height,
+    };
+    render_texture(rdata, view->texture_cache.texture, &src_box, &box, WL_OUTPUT_TRANSFORM_NORMAL);
+
+    // Every surface in the cache was drawn, as far as its client is concerned
+    if (rdata->is_primary_output) {
+        wlr_surface_for_each_surface(view->xdg_surface->surface, send_cached_surface_feedback, rdata);
+    }
+}
+
+void viv_render_view_texture_cache_invalidate(struct viv_view *view) {
+    view->texture_cache.dirty = true;
+    view->texture_cache.committed_since_update = true;
+}
+
+void viv_render_view_texture_cache_fini(struct viv_view *view) {
+    release_texture_cache(view);
+}
 
-    // Update floating view sizes, as the client has control over it
-    if (view->is_floating || (view->workspace->fullscreen_view == view)) {
-        viv_view_match_target_box_with_surface_geometry(view);
-        // TODO: recenter fullscreen?
+static void viv_render_xdg_view(struct viv_render_frame *frame, struct viv_view *view, pixman_region32_t *occluded) {
+    if (!view->mapped) {
+        // Unmapped views don't need any further rendering
+        return;
     }
 
-    viv_output_layout_coords_box_to_output_coords(output, target_geometry);
+    struct viv_output *output = frame->output;
 
-    pixman_region32_t surface_bounds;
-    pixman_region32_init(&surface_bounds);
-    pixman_region32_copy(&surface_bounds, damage);
+    // Note this renders both the toplevel and any popups
+    pixman_region32_t *surface_bounds = &frame->scratch->surface_bounds;
 
-    bool apply_surface_bounds = (output->server->config->damage_tracking_mode == VIV_DAMAGE_TRACKING_FULL);
+    struct wlr_box clip_box;
+    bool apply_surface_bounds = view_get_surface_clip_box(view, output, &clip_box);
     if (apply_surface_bounds) {
-        pixman_region32_intersect_rect(&surface_bounds, &surface_bounds, target_geometry->x, target_geometry->y, target_geometry->width, target_geometry->height);
+        pixman_region32_intersect_rect(surface_bounds, frame->damage, clip_box.x, clip_box.y, clip_box.width, clip_box.height);
     }
 
     struct viv_render_data rdata = {
-        .output = output->wlr_output,
+        .frame = frame,
         .view = view,
-        .renderer = renderer,
-        .when = &now,
         .limit_render_count = true,
         .sx = 0,
         .sy = 0,
-        .damage = damage,
-        .surface_bounds = apply_surface_bounds ? &surface_bounds : NULL,
+        .surface_bounds = apply_surface_bounds ? surface_bounds : NULL,
+        .occluded = occluded,
+        .is_primary_output = (viv_view_get_primary_output(view) == output),
     };
 
     // Render only the main surfaces (not popups)
-    wlr_surface_for_each_surface(view->xdg_surface->surface, render_surface, &rdata);
+    if (view_texture_cache_is_usable(view, output)) {
+        render_view_texture_cache(&rdata);
+    } else {
+        wlr_surface_for_each_surface(view->xdg_surface->surface, render_surface, &rdata);
+    }
 
     // Then render the main surface's borders
-    struct viv_seat *seat = viv_server_get_default_seat(view->server);
-    bool is_grabbed = ((seat->cursor_mode != VIV_CURSOR_PASSTHROUGH) &&
-                       viv_server_any_seat_grabs(view->server, view));
-    bool is_active_on_current_output = ((output == output->server->active_output) &
-                                        (view == view->workspace->active_view));
-    bool is_active = is_grabbed || is_active_on_current_output;
+    pixman_region32_t *visible_damage = get_visible_damage(frame, occluded);
     if (view->workspace->fullscreen_view == view) {
-        render_fullscreen_fill(view, output, damage);
-    } else if ((view->is_floating || !view->workspace->active_layout->no_borders)) {
-        render_borders(view, output, damage, is_active);
+        render_fullscreen_fill(frame, view, visible_damage);
+    } else if (viv_view_draws_borders(view)) {
+        render_borders(frame, view, visible_damage, viv_view_is_active_on_output(view, output));
     }
 
     // Then render any popups
@@ -313,62 +782,48 @@ static void viv_render_xdg_view(struct wlr_renderer *renderer, struct viv_view *
         };
         float output_marker_colour[4] = {0, 1, 0, 0.5};
         if (output == output->server->active_output) {
-            wlr_render_rect(renderer, &output_marker_box, output_marker_colour, output->wlr_output->transform_matrix);
+            wlr_render_rect(frame->renderer, &output_marker_box, output_marker_colour, frame->projection);
         }
     }
 #endif
-
-    pixman_region32_fini(&surface_bounds);
 }
 
 #ifdef XWAYLAND
-static void viv_render_xwayland_view(struct wlr_renderer *renderer, struct viv_view *view, struct viv_output *output, pixman_region32_t *damage) {
-    UNUSED(damage);
+static void viv_render_xwayland_view(struct viv_render_frame *frame, struct viv_view *view, pixman_region32_t *occluded) {
     if (!view->mapped) {
         // Unmapped views don't need any further rendering
         return;
     }
 
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct viv_output *output = frame->output;
 
-    struct wlr_box *target_geometry = &view->target_box;
+    struct wlr_box clip_box;
+    view_get_surface_clip_box(view, output, &clip_box);
 
-    pixman_region32_t surface_bounds;
-    pixman_region32_init(&surface_bounds);
-    pixman_region32_union_rect(&surface_bounds, &surface_bounds,
-                               target_geometry->x, target_geometry->y, target_geometry->width, target_geometry->height);
+    pixman_region32_t *surface_bounds = &frame->scratch->surface_bounds;
+    pixman_region32_intersect_rect(surface_bounds, frame->damage, clip_box.x, clip_box.y, clip_box.width, clip_box.height);
 
     struct viv_render_data rdata = {
-        .output = output->wlr_output,
+        .frame = frame,
         .view = view,
-        .renderer = renderer,
-        .when = &now,
         .limit_render_count = false,
         .sx = 0,
         .sy = 0,
-        .damage = damage,
-        .surface_bounds = &surface_bounds,
+        .surface_bounds = surface_bounds,
+        .occluded = occluded,
+        .is_primary_output = (viv_view_get_primary_output(view) == output),
     };
 
     wlr_surface_for_each_surface(viv_view_get_toplevel_surface(view), render_surface, &rdata);
 
     // Then render the main surface's borders
-    struct viv_seat *seat = viv_server_get_default_seat(view->server);
-    bool is_grabbed = ((seat->cursor_mode != VIV_CURSOR_PASSTHROUGH) &&
-                       viv_server_any_seat_grabs(view->server, view));
-    bool is_active_on_current_output = ((output == output->server->active_output) &
-                                        (view == view->workspace->active_view));
-    bool is_active = is_grabbed || is_active_on_current_output;
+    pixman_region32_t *visible_damage = get_visible_damage(frame, occluded);
     if (view->workspace->fullscreen_view == view) {
-        render_fullscreen_fill(view, output, damage);
-    } else if (!view->is_static &&
-        (view->is_floating || !view->workspace->active_layout->no_borders)) {
-        render_borders(view, output, damage, is_active);
+        render_fullscreen_fill(frame, view, visible_damage);
+    } else if (viv_view_draws_borders(view)) {
+        render_borders(frame, view, visible_damage, viv_view_is_active_on_output(view, output));
     }
 
-    pixman_region32_fini(&surface_bounds);
-
 #ifdef DEBUG
     if (output->server->config->debug_mark_views_by_shell) {
         // Mark this as an xwayland view
@@ -377,21 +832,21 @@ static void viv_render_xwayland_view(struct wlr_renderer *renderer, struct viv_v
         };
         float output_marker_colour[4] = {1, 0, 0, 0.5};
         if (output == output->server->active_output) {
-            wlr_render_rect(renderer, &output_marker_box, output_marker_colour, output->wlr_output->transform_matrix);
+            wlr_render_rect(frame->renderer, &output_marker_box, output_marker_colour, frame->projection);
         }
     }
 #endif  // DEBUG
 }
 #endif  // XWAYLAND
 
-void viv_render_view(struct wlr_renderer *renderer, struct viv_view *view, struct viv_output *output, pixman_region32_t *damage) {
+void viv_render_view(struct viv_render_frame *frame, struct viv_view *view, pixman_region32_t *occluded) {
     switch (view->type) {
     case VIV_VIEW_TYPE_XDG_SHELL:
-        viv_render_xdg_view(renderer, view, output, damage);
+        viv_render_xdg_view(frame, view, occluded);
         break;
 #ifdef XWAYLAND
     case VIV_VIEW_TYPE_XWAYLAND:
-        viv_render_xwayland_view(renderer, view, output, damage);
+        viv_render_xwayland_view(frame, view, occluded);
         break;
 #endif
     default:
@@ -399,40 +854,43 @@ void viv_render_view(struct wlr_renderer *renderer, struct viv_view *view, struc
     }
 }
 
+/// Get the box of the given layer view's main surface, in output coordinates
+static void layer_view_get_output_box(struct viv_layer_view *layer_view, struct viv_output *output, struct wlr_box *box) {
+    box->x = layer_view->x;
+    box->y = layer_view->y;
+    box->width = layer_view->layer_surface->current.actual_width;
+    box->height = layer_view->layer_surface->current.actual_height;
+    layout_box_to_render_box(output, box);
+}
 
-void viv_render_layer_view(struct wlr_renderer *renderer, struct viv_layer_view *layer_view, struct viv_output *output, pixman_region32_t *damage) {
+void viv_render_layer_view(struct viv_render_frame *frame, struct viv_layer_view *layer_view, pixman_region32_t *occluded) {
     if (!layer_view->mapped) {
         // Unmapped layer views don't need drawing
         return;
     }
 
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct viv_output *output = frame->output;
 
-    pixman_region32_t surface_bounds;
-    pixman_region32_init(&surface_bounds);
-    pixman_region32_union_rect(&surface_bounds, &surface_bounds,
-                               layer_view->x, layer_view->y,
-                               layer_view->layer_surface->current.actual_width,
-                               layer_view->layer_surface->current.actual_height);
+    struct wlr_box layer_box;
+    layer_view_get_output_box(layer_view, output, &layer_box);
+
+    pixman_region32_t *surface_bounds = &frame->scratch->surface_bounds;
+    pixman_region32_intersect_rect(surface_bounds, frame->damage, layer_box.x, layer_box.y, layer_box.width, layer_box.height);
 
     struct viv_view view = {.x = layer_view->x, .y = layer_view->y, .server = output->server};
     struct viv_render_data rdata = {
-        .output = output->wlr_output,
+        .frame = frame,
         .view = &view,
-        .renderer = renderer,
-        .when = &now,
         .limit_render_count = false,
-        .damage = damage,
-        .surface_bounds = &surface_bounds,
+        .surface_bounds = surface_bounds,
+        .occluded = occluded,
+        .is_primary_output = true,  // layer views are only ever on one output
     };
 
     wlr_layer_surface_v1_for_each_surface(layer_view->layer_surface, render_surface, &rdata);
 
     rdata.surface_bounds = NULL;  // surface bounds don't apply to popups
     wlr_layer_surface_v1_for_each_popup_surface(layer_view->layer_surface, render_surface, &rdata);
-
-    pixman_region32_fini(&surface_bounds);
 }
 
 static bool viv_layer_is(struct viv_layer_view *layer_view, enum zwlr_layer_shell_v1_layer layer) {
@@ -442,84 +900,187 @@ static bool viv_layer_is(struct viv_layer_view *layer_view, enum zwlr_layer_shel
     return false;
 }
 
-void viv_render_output(struct wlr_renderer *renderer, struct viv_output *output) {
-    pixman_region32_t damage;
-    bool needs_frame;
-    pixman_region32_init(&damage);
-    bool attach_render_success = wlr_output_damage_attach_render(output->damage, &needs_frame, &damage);
-    if (!attach_render_success) {
-        return;
-    }
-    if (!needs_frame) {
-        wlr_output_rollback(output->wlr_output);
+/// Data for gathering the opaque regions of a tree of surfaces
+struct viv_opaque_data {
+    struct viv_output *output;
+    double ox;  // the output's offset from get_output_offset
+    double oy;
+    int lx;
+    int ly;
+    struct wlr_box *clip_box;  // optional bounds outside which the surfaces are not drawn
+    pixman_region32_t *opaque;
+};
+
+static void add_surface_opaque_region(struct wlr_surface *surface, int sx, int sy, void *data) {
+    struct viv_opaque_data *odata = data;
+    float scale = get_render_scale(odata->output);
+
+    if ((wlr_surface_get_texture(surface) == NULL) || !pixman_region32_not_empty(&surface->opaque_region)) {
+        // Nothing opaque will be drawn, so nothing will be hidden
         return;
     }
 
-    if (output->server->config->damage_tracking_mode == VIV_DAMAGE_TRACKING_FRAME) {
-        // If in "draw whole frame" mode, damage the full output to ensure it gets drawn
-        int width, height;
-        wlr_output_transformed_resolution(output->wlr_output, &width, &height);
-        pixman_region32_union_rect(&damage, &damage, 0, 0, width, height);
+    // Match the box that render_surface will draw to
+    struct wlr_box box;
+    get_surface_output_box(surface, scale, odata->ox, odata->oy, odata->lx + sx, odata->ly + sy, &box);
+
+    struct viv_render_scratch *scratch = &odata->output->render_scratch;
+    pixman_region32_t *surface_opaque = &scratch->surface_opaque;
+    pixman_region32_t *spare_opaque = &scratch->surface_opaque_spare;
+    viv_geometry_layout_region_to_output_region(spare_opaque, &surface->opaque_region,
+                                                odata->ox + odata->lx + sx, odata->oy + odata->ly + sy,
+                                                scale, VIV_GEOMETRY_ROUND_NEAREST, &odata->output->geometry_scratch);
+    pixman_region32_intersect_rect(surface_opaque, spare_opaque, box.x, box.y, box.width, box.height);
+    if (odata->clip_box) {
+        struct wlr_box *clip_box = odata->clip_box;
+        pixman_region32_intersect_rect(spare_opaque, surface_opaque,
+                                       clip_box->x, clip_box->y, clip_box->width, clip_box->height);
+        swap_regions(&surface_opaque, &spare_opaque);
     }
 
-    /* The "effective" resolution can change if you rotate your outputs. */
-    int width, height;
-    wlr_output_effective_resolution(output->wlr_output, &width, &height);
-    /* Begin the renderer (calls glViewport and some other GL sanity checks) */
-    wlr_renderer_begin(renderer, width, height);
+    // Union out of place and copy back, as the copy can reuse the existing storage
+    pixman_region32_union(&scratch->opaque_union, odata->opaque, surface_opaque);
+    pixman_region32_copy(odata->opaque, &scratch->opaque_union);
+}
 
-    if (output->server->config->debug_mark_undamaged_regions) {
-        // Clear the output with a solid colour, so that it is easy to
-        // see what rendering has taken place this frame.
-        wlr_renderer_clear(renderer, (float[]){0.95, 0.2, 0.2, 1.0});
-    }
+/// Add the view's border or fullscreen fill to the opaque region, if it is drawn fully
+/// opaque. Only used with the software renderer, for which clearing or drawing anything
+/// beneath the fill costs as much as the fill itself.
+static void add_view_fill_opaque_region(struct viv_view *view, struct viv_opaque_data *odata) {
+    struct viv_output *output = odata->output;
+    struct viv_config *config = output->server->config;
+    struct viv_render_scratch *scratch = &output->render_scratch;
+    pixman_region32_t *fill = &scratch->surface_opaque;
 
-    int num_rects;
-    pixman_box32_t *rects = pixman_region32_rectangles(&damage, &num_rects);
-    for (int i = 0; i < num_rects; i++) {
-        pixman_box32_t rect = rects[i];
-        struct wlr_box box = {
-            .x = rect.x1,
-            .y = rect.y1,
-            .width = rect.x2 - rect.x1,
-            .height = rect.y2 - rect.y1,
+    if (view->workspace->fullscreen_view == view) {
+        // Match render_fullscreen_fill, which covers the whole output around the view
+        struct wlr_box view_box = view->target_box;
+        layout_box_to_render_box(output, &view_box);
+        int width, height;
+        get_render_resolution(output, &width, &height);
+
+        pixman_box32_t output_rect = {.x1 = 0, .y1 = 0, .x2 = width, .y2 = height};
+        pixman_box32_t view_rect = {
+            .x1 = view_box.x,
+            .y1 = view_box.y,
+            .x2 = view_box.x + view_box.width,
+            .y2 = view_box.y + view_box.height,
         };
-        wlr_renderer_scissor(renderer, &box);
-        wlr_renderer_clear(renderer, output->server->config->clear_colour);
+        pixman_region32_reset(&scratch->surface_opaque_spare, &view_rect);
+        pixman_region32_inverse(fill, &scratch->surface_opaque_spare, &output_rect);
+    } else if (viv_view_draws_borders(view)) {
+        float *colour = (viv_view_is_active_on_output(view, output) ?
+                         config->active_border_colour :
+                         config->inactive_border_colour);
+        if (colour[3] < 1) {
+            return;
+        }
+        // Match render_borders
+        layout_region_to_render_region(output, fill, viv_view_get_border_region(view),
+                                       VIV_GEOMETRY_ROUND_NEAREST);
+    } else {
+        return;
     }
 
-    struct viv_view *view;
+    pixman_region32_union(&scratch->opaque_union, odata->opaque, fill);
+    pixman_region32_copy(odata->opaque, &scratch->opaque_union);
+}
 
-    struct viv_layer_view *layer_view;
+/// Add to the given region the part of the output that the entry is guaranteed to cover
+/// with opaque surface content. Popups are ignored, which errs on the side of drawing too
+/// much rather than too little.
+static void add_render_entry_opaque_region(struct viv_render_entry *entry, struct viv_output *output, pixman_region32_t *opaque) {
+    struct viv_opaque_data odata = {
+        .output = output,
+        .opaque = opaque,
+    };
+    get_output_offset(output, &odata.ox, &odata.oy);
+    struct wlr_box clip_box;
 
-    if (output->current_workspace->fullscreen_view) {
-        viv_render_view(renderer, output->current_workspace->fullscreen_view, output, &damage);
+    if (entry->view) {
+        struct viv_view *view = entry->view;
+        if (!view->mapped) {
+            return;
+        }
+        odata.lx = view->x;
+        odata.ly = view->y;
+        if (view_get_surface_clip_box(view, output, &clip_box)) {
+            odata.clip_box = &clip_box;
+        }
+        wlr_surface_for_each_surface(viv_view_get_toplevel_surface(view), add_surface_opaque_region, &odata);
+        if (output->server->software_renderer) {
+            add_view_fill_opaque_region(view, &odata);
+        }
     } else {
-        // First render layer-protocol surfaces in the background or bottom layers
-        wl_list_for_each_reverse(layer_view, &output->layer_views, output_link) {
-            if (viv_layer_is(layer_view, ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND)) {
-                viv_render_layer_view(renderer, layer_view, output, &damage);
-            }
+        struct viv_layer_view *layer_view = entry->layer_view;
+        if (!layer_view->mapped) {
+            return;
         }
-        wl_list_for_each_reverse(layer_view, &output->layer_views, output_link) {
-            if (viv_layer_is(layer_view, ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM)) {
-                viv_render_layer_view(renderer, layer_view, output, &damage);
-            }
+        odata.lx = layer_view->x;
+        odata.ly = layer_view->y;
+        layer_view_get_output_box(layer_view, output, &clip_box);
+        odata.clip_box = &clip_box;
+        wlr_layer_surface_v1_for_each_surface(layer_view->layer_surface, add_surface_opaque_region, &odata);
+    }
+}
+
+static void add_render_entry(struct wl_array *entries, struct viv_view *view, struct viv_layer_view *layer_view) {
+    struct viv_render_entry *entry = wl_array_add(entries, sizeof(struct viv_render_entry));
+    CHECK_ALLOCATION(entry);
+    entry->view = view;
+    entry->layer_view = layer_view;
+    entry->hidden = false;
+    pixman_region32_init(&entry->occluded);
+}
+
+/// Remove all the entries, releasing their storage
+static void clear_render_entries(struct wl_array *entries) {
+    struct viv_render_entry *entry;
+    wl_array_for_each(entry, entries) {
+        pixman_region32_fini(&entry->occluded);
+    }
+    entries->size = 0;
+}
+
+static void add_layer_render_entries(struct wl_array *entries, struct viv_output *output, enum zwlr_layer_shell_v1_layer layer) {
+    struct viv_layer_view *layer_view;
+    wl_list_for_each_reverse(layer_view, &output->layer_views, output_link) {
+        if (viv_layer_is(layer_view, layer)) {
+            add_render_entry(entries, NULL, layer_view);
         }
+    }
+}
+
+/// Fill the output's render entries with everything that may be drawn, in the order in
+/// which it must be drawn (back to front)
+static void build_render_entries(struct viv_output *output) {
+    struct wl_array *entries = &output->render_entries;
+    clear_render_entries(entries);
+    output->render_entries_occlusion_valid = false;
+
+    struct viv_workspace *workspace = output->current_workspace;
+    struct viv_view *view;
+
+    if (workspace->fullscreen_view) {
+        add_render_entry(entries, workspace->fullscreen_view, NULL);
+    } else {
+        // First render layer-protocol surfaces in the background or bottom layers
+        add_layer_render_entries(entries, output, ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND);
+        add_layer_render_entries(entries, output, ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM);
 
         // Begin rendering actual views: first render tiled windows
-        wl_list_for_each_reverse(view, &output->current_workspace->views, workspace_link) {
-            if (view->is_floating || (view == output->current_workspace->active_view)) {
+        wl_list_for_each_reverse(view, &workspace->views, workspace_link) {
+            if (view->is_floating || (view == workspace->active_view)) {
                 continue;
             }
-            viv_render_view(renderer, view, output, &damage);
+            add_render_entry(entries, view, NULL);
         }
 
         // Then render the active view if necessary
-        if ((output->current_workspace->active_view != NULL) &&
-            (output->current_workspace->active_view->mapped) &&
-            (!output->current_workspace->active_view->is_floating)) {
-            viv_render_view(renderer, output->current_workspace->active_view, output, &damage);
+        if ((workspace->active_view != NULL) &&
+            (workspace->active_view->mapped) &&
+            (!workspace->active_view->is_floating)) {
+            add_render_entry(entries, workspace->active_view, NULL);
         }
 
         // Render floating views that may be overhanging other workspaces
@@ -533,30 +1094,766 @@ void viv_render_output(struct wlr_renderer *renderer, struct viv_output *output)
                 if (!view->is_floating) {
                     continue;
                 }
-                viv_render_view(renderer, view, output, &damage);
+                add_render_entry(entries, view, NULL);
             }
         }
 
         // Finally render all floating views on this output (which may include the active view)
-        wl_list_for_each_reverse(view, &output->current_workspace->views, workspace_link) {
+        wl_list_for_each_reverse(view, &workspace->views, workspace_link) {
             if (!view->is_floating) {
                 continue;
             }
-            viv_render_view(renderer, view, output, &damage);
+            add_render_entry(entries, view, NULL);
         }
 
         // Render any layer surfaces that should go on top of views
-        wl_list_for_each_reverse(layer_view, &output->layer_views, output_link) {
-            if (viv_layer_is(layer_view, ZWLR_LAYER_SHELL_V1_LAYER_TOP)) {
-                viv_render_layer_view(renderer, layer_view, output, &damage);
+        add_layer_render_entries(entries, output, ZWLR_LAYER_SHELL_V1_LAYER_TOP);
+    }
+
+    // Overlays on top of fullscreen views
+    add_layer_render_entries(entries, output, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY);
+}
+
+void viv_render_invalidate_entries(struct viv_server *server) {
+    server->render_entries_generation++;
+}
+
+/// Whether the view is tiled, i.e. placed by the workspace's layout
+static bool view_is_tiled(struct viv_view *view) {
+    return !view->is_floating && (view->workspace->fullscreen_view != view);
+}
+
+/// Whether the box, in render coordinates, is entirely covered by either region
+static bool box_is_covered(struct viv_output *output, struct wlr_box *box, pixman_region32_t *opaque,
+                           pixman_region32_t *fills) {
+    pixman_box32_t rect = {
+        .x1 = box->x,
+        .y1 = box->y,
+        .x2 = box->x + box->width,
+        .y2 = box->y + box->height,
+    };
+    if (pixman_region32_contains_rectangle(opaque, &rect) == PIXMAN_REGION_IN) {
+        return true;
+    }
+    if (!pixman_region32_not_empty(fills)) {
+        return false;
+    }
+    pixman_region32_t *covered = &output->render_scratch.view_covered;
+    pixman_region32_union(covered, opaque, fills);
+    return pixman_region32_contains_rectangle(covered, &rect) == PIXMAN_REGION_IN;
+}
+
+/// Walk the render entries from front to back, storing in each the region that will be
+/// covered by opaque surfaces drawn after it. The union of all opaque regions is written
+/// to total_opaque. Tiled views whose whole box is covered, e.g. every inactive view in the
+/// fullscreen layout when the active one is opaque, are marked hidden and cover nothing.
+static void compute_render_entry_occlusion(struct viv_output *output, pixman_region32_t *total_opaque) {
+    struct wl_array *entries = &output->render_entries;
+    size_t num_entries = entries->size / sizeof(struct viv_render_entry);
+    struct viv_render_entry *first_entry = entries->data;
+
+    // Borders and fullscreen fills only occlude with the software renderer, but they still
+    // hide whatever is beneath them
+    pixman_region32_t *fills = &output->render_scratch.opaque_fills;
+    pixman_region32_clear(fills);
+    struct viv_opaque_data fill_odata = {
+        .output = output,
+        .opaque = fills,
+    };
+    output->render_stats.hidden_views = 0;
+
+    for (size_t i = num_entries; i > 0; i--) {
+        struct viv_render_entry *entry = &first_entry[i - 1];
+        pixman_region32_data_t *old_data = entry->occluded.data;
+        pixman_region32_copy(&entry->occluded, total_opaque);
+        if (region_was_allocated(&entry->occluded, old_data)) {
+            output->render_stats.allocations++;
+        }
+
+        struct viv_view *view = entry->view;
+        entry->hidden = false;
+        if (view && view->mapped && view_is_tiled(view)) {
+            struct wlr_box box = view->target_box;
+            layout_box_to_render_box(output, &box);
+            if (box_is_covered(output, &box, total_opaque, fills)) {
+                // Hidden views aren't drawn, so cover nothing
+                entry->hidden = true;
+                output->render_stats.hidden_views++;
+                continue;
             }
         }
+
+        add_render_entry_opaque_region(entry, output, total_opaque);
+        if (view && view->mapped && !output->server->software_renderer) {
+            add_view_fill_opaque_region(view, &fill_odata);
+        }
     }
+    output->render_entries_occlusion_valid = true;
+}
 
-    // Overlays on top of fullscreen views
-    wl_list_for_each_reverse(layer_view, &output->layer_views, output_link) {
-        if (viv_layer_is(layer_view, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY)) {
-            viv_render_layer_view(renderer, layer_view, output, &damage);
+/// Bring the output's render entries up to date, rebuilding the list only if stacking has
+/// changed since it was last built
+static void collect_render_entries(struct viv_output *output) {
+    uint32_t generation = output->server->render_entries_generation;
+    if (output->render_entries_generation != generation) {
+        build_render_entries(output);
+        output->render_entries_generation = generation;
+    }
+
+    // Floating and fullscreen xdg views can be resized by the client at any time, so
+    // their target boxes must be updated before working out what they cover
+    struct viv_render_entry *entry;
+    wl_array_for_each(entry, &output->render_entries) {
+        struct viv_view *view = entry->view;
+        if (view && view->mapped && (view->type == VIV_VIEW_TYPE_XDG_SHELL) && !view_is_tiled(view)) {
+            viv_view_match_target_box_with_surface_geometry(view);
+            // TODO: recenter fullscreen?
+        }
+    }
+
+    // Surfaces can change their opaque regions with any commit, so this must be redone
+    // every time
+    pixman_region32_t *total_opaque = &output->render_scratch.total_opaque;
+    pixman_region32_clear(total_opaque);
+    compute_render_entry_occlusion(output, total_opaque);
+}
+
+bool viv_render_get_view_occlusion(struct viv_output *output, struct viv_view *view, pixman_region32_t *occluded) {
+    // Reuse the occlusion worked out for the latest frame rather than walking every surface
+    // above the view for every commit. Anything that has since moved away from the view
+    // damaged the area it uncovered, so the stale occlusion never hides visible damage.
+    if ((output->render_entries_generation != output->server->render_entries_generation) ||
+        !output->render_entries_occlusion_valid) {
+        // The stacking has changed since, so assume nothing covers the view
+        return true;
+    }
+
+    struct viv_render_entry *entry;
+    wl_array_for_each(entry, &output->render_entries) {
+        if (entry->view != view) {
+            continue;
+        }
+        // Opaque regions are found in the coordinates the output is composited in, which
+        // don't match the output's damage when it has a reduced render scale
+        if (!output_has_reduced_render(output)) {
+            pixman_region32_copy(occluded, &entry->occluded);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+void viv_render_for_each_entry(struct viv_output *output,
+                               void (*iterator)(struct viv_view *view, struct viv_layer_view *layer_view, void *data),
+                               void *data) {
+    collect_render_entries(output);
+
+    struct viv_render_entry *entry;
+    wl_array_for_each(entry, &output->render_entries) {
+        iterator(entry->view, entry->layer_view, data);
+    }
+}
+
+static void send_surface_frame_done(struct wlr_surface *surface, int sx, int sy, void *data) {
+    UNUSED(sx);
+    UNUSED(sy);
+    struct timespec *when = data;
+
+    // Match render_surface, which skips surfaces without a buffer
+    if (wlr_surface_get_texture(surface) == NULL) {
+        return;
+    }
+    wlr_surface_send_frame_done(surface, when);
+}
+
+static void send_view_frame_done(struct viv_view *view, struct timespec *when) {
+    wlr_surface_for_each_surface(viv_view_get_toplevel_surface(view), send_surface_frame_done, when);
+    if (view->type == VIV_VIEW_TYPE_XDG_SHELL) {
+        wlr_xdg_surface_for_each_popup_surface(view->xdg_surface, send_surface_frame_done, when);
+    }
+}
+
+/// Send frame done events to a view hidden by the layout, but no more often than the
+/// configured rate, so that its client draws less while nobody can see it
+static void send_hidden_view_frame_done(struct viv_view *view, struct timespec *when) {
+    double rate = view->server->config->render.hidden_view_frame_rate;
+    int64_t when_msec = (int64_t)when->tv_sec * 1000 + when->tv_nsec / 1000000;
+    if ((rate > 0) && ((when_msec - view->hidden_frame_done_msec) < (1000 / rate))) {
+        return;
+    }
+    view->hidden_frame_done_msec = when_msec;
+    send_view_frame_done(view, when);
+}
+
+void viv_render_send_frame_done(struct viv_output *output, struct timespec *when) {
+    collect_render_entries(output);
+
+    struct viv_render_entry *entry;
+    wl_array_for_each(entry, &output->render_entries) {
+        if (entry->view) {
+            struct viv_view *view = entry->view;
+            if (!view->mapped || (viv_view_get_primary_output(view) != output)) {
+                continue;
+            }
+            if (entry->hidden) {
+                send_hidden_view_frame_done(view, when);
+            } else {
+                send_view_frame_done(view, when);
+            }
+        } else {
+            struct viv_layer_view *layer_view = entry->layer_view;
+            if (!layer_view->mapped) {
+                continue;
+            }
+            wlr_layer_surface_v1_for_each_surface(layer_view->layer_surface, send_surface_frame_done, when);
+            wlr_layer_surface_v1_for_each_popup_surface(layer_view->layer_surface, send_surface_frame_done, when);
+        }
+    }
+}
+
+static void count_surface(struct wlr_surface *surface, int sx, int sy, void *data) {
+    UNUSED(surface);
+    UNUSED(sx);
+    UNUSED(sy);
+    size_t *num_surfaces = data;
+    (*num_surfaces)++;
+}
+
+static bool output_has_visible_software_cursor(struct wlr_output *wlr_output) {
+    struct wlr_output_cursor *cursor;
+    wl_list_for_each(cursor, &wlr_output->cursors, link) {
+        if (cursor->enabled && cursor->visible && (cursor != wlr_output->hardware_cursor)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Check whether the fullscreen view is the only thing that needs drawing on the output,
+/// with a single surface whose buffer exactly covers the output. If so, return that
+/// surface, otherwise NULL.
+static struct wlr_surface *get_scanout_surface(struct viv_output *output) {
+    struct viv_server *server = output->server;
+    struct viv_config *config = server->config;
+    struct wlr_output *wlr_output = output->wlr_output;
+    struct viv_view *view = output->current_workspace->fullscreen_view;
+
+    if (!config->debug_allow_direct_scanout || !view || !view->mapped) {
+        return NULL;
+    }
+
+    // Nothing can be drawn on top of the client buffer
+    if (config->debug_mark_views_by_shell || config->debug_mark_active_output ||
+        config->debug_mark_undamaged_regions || config->debug_mark_frame_draws) {
+        return NULL;
+    }
+    struct viv_layer_view *layer_view;
+    wl_list_for_each(layer_view, &output->layer_views, output_link) {
+        if (layer_view->mapped && viv_layer_is(layer_view, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY)) {
+            return NULL;
+        }
+    }
+    if (output_has_visible_software_cursor(wlr_output)) {
+        return NULL;
+    }
+
+    // Only a single surface can be scanned out, so any subsurfaces or popups rule it out
+    struct wlr_surface *surface = viv_view_get_toplevel_surface(view);
+    size_t num_surfaces = 0;
+    wlr_surface_for_each_surface(surface, count_surface, &num_surfaces);
+    if (view->type == VIV_VIEW_TYPE_XDG_SHELL) {
+        wlr_xdg_surface_for_each_popup_surface(view->xdg_surface, count_surface, &num_surfaces);
+    }
+    if (num_surfaces != 1) {
+        return NULL;
+    }
+
+    // The buffer must be displayable as-is, filling the whole output
+    if ((surface->buffer == NULL) ||
+        ((float)surface->current.scale != wlr_output->scale) ||
+        (surface->current.transform != wlr_output->transform) ||
+        surface->current.viewport.has_src) {
+        return NULL;
+    }
+    struct wlr_buffer *buffer = &surface->buffer->base;
+    if ((buffer->width != wlr_output->width) || (buffer->height != wlr_output->height)) {
+        return NULL;
+    }
+    double ox, oy;
+    get_output_offset(output, &ox, &oy);
+    struct wlr_box box;
+    get_surface_output_box(surface, wlr_output->scale, ox, oy, view->x, view->y, &box);
+    int output_width, output_height;
+    wlr_output_transformed_resolution(wlr_output, &output_width, &output_height);
+    if ((box.x != 0) || (box.y != 0) ||
+        (box.width != output_width) || (box.height != output_height)) {
+        return NULL;
+    }
+
+    return surface;
+}
+
+/// The outcome of trying to scan out the output's fullscreen view
+enum scanout_result {
+    SCANOUT_DONE,  // the client's buffer was committed
+    SCANOUT_NOTHING_TO_DO,  // the client's buffer is still the one being scanned out
+    SCANOUT_IMPOSSIBLE,  // the output must be rendered as normal
+};
+
+/// Try to display the output's fullscreen view by attaching its buffer directly to the
+/// output
+static enum scanout_result scan_out_fullscreen_view(struct viv_output *output) {
+    struct wlr_output *wlr_output = output->wlr_output;
+
+    struct wlr_surface *surface = get_scanout_surface(output);
+    if (surface == NULL) {
+        return SCANOUT_IMPOSSIBLE;
+    }
+
+    if (output->render_stats.scanout_active && !wlr_output->needs_frame &&
+        !pixman_region32_not_empty(&output->damage->current)) {
+        // The client hasn't committed a new buffer since the last one was scanned out
+        return SCANOUT_NOTHING_TO_DO;
+    }
+
+    wlr_presentation_surface_sampled_on_output(output->server->presentation, surface, wlr_output);
+    wlr_output_attach_buffer(wlr_output, &surface->buffer->base);
+    if (!wlr_output_test(wlr_output)) {
+        wlr_output_rollback(wlr_output);
+        return SCANOUT_IMPOSSIBLE;
+    }
+
+    // The client's buffer only differs from the last frame by the output's damage if the
+    // last frame was also scanned out, otherwise leave the damage unset so that capture
+    // clients and mirrors take the whole frame
+    bool success;
+    if (output->render_stats.scanout_active) {
+        set_output_frame_damage(output);
+        success = viv_output_commit(output, &output->damage->current);
+    } else {
+        success = wlr_output_commit(wlr_output);
+    }
+    if (!success) {
+        return SCANOUT_IMPOSSIBLE;
+    }
+
+    if (!output->render_schedule.frame_done_sent) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        wlr_surface_send_frame_done(surface, &now);
+    }
+
+    return SCANOUT_DONE;
+}
+
+/// Replace the frame's damage with its bounding box if it is split into more rects than
+/// configured, or if the bounding box would not redraw much undamaged area. Every rect costs
+/// a scissored draw call for each surface it touches, so fewer, larger rects are often
+/// cheaper even though more pixels are drawn.
+static void coalesce_damage(struct viv_render_frame *frame) {
+    struct viv_config *config = frame->output->server->config;
+    pixman_region32_t *damage = frame->damage;
+
+    int num_rects;
+    pixman_box32_t *rects = pixman_region32_rectangles(damage, &num_rects);
+    frame->output->render_stats.damage_rects_before = num_rects;
+
+    if (num_rects > 1) {
+        pixman_box32_t *extents = pixman_region32_extents(damage);
+        uint64_t extents_area = (uint64_t)(extents->x2 - extents->x1) * (uint64_t)(extents->y2 - extents->y1);
+
+        bool too_many_rects = ((config->render.damage_max_rects > 0) &&
+                               ((uint32_t)num_rects > config->render.damage_max_rects));
+        bool coalesce = too_many_rects;
+        if (!coalesce && (extents_area > 0)) {
+            uint64_t damaged_area = 0;
+            for (int i = 0; i < num_rects; i++) {
+                damaged_area += (uint64_t)(rects[i].x2 - rects[i].x1) * (uint64_t)(rects[i].y2 - rects[i].y1);
+            }
+            double waste = (double)(extents_area - damaged_area) / (double)extents_area;
+            coalesce = (waste <= config->render.damage_max_waste);
+        }
+
+        if (coalesce) {
+            pixman_box32_t bounding_box = *extents;
+            pixman_region32_reset(damage, &bounding_box);
+            num_rects = 1;
+        }
+    }
+
+    frame->output->render_stats.damage_rects_after = num_rects;
+}
+
+/// Get why the frame's damage should be redrawn as a whole frame in the auto damage
+/// tracking mode, or NULL if only the damaged regions should be redrawn
+static const char *get_auto_whole_frame_reason(struct viv_render_frame *frame) {
+    struct viv_output *output = frame->output;
+    struct viv_config *config = output->server->config;
+
+    int num_rects;
+    pixman_box32_t *rects = pixman_region32_rectangles(frame->damage, &num_rects);
+    if (num_rects == 0) {
+        return NULL;
+    }
+
+    if ((config->render.auto_whole_frame_rects > 0) &&
+        ((uint32_t)num_rects >= config->render.auto_whole_frame_rects)) {
+        return "fragmented damage";
+    }
+
+    uint64_t output_area = (uint64_t)frame->transformed_width * (uint64_t)frame->transformed_height;
+    if ((config->render.auto_whole_frame_area > 0) && (output_area > 0)) {
+        uint64_t damaged_area = 0;
+        for (int i = 0; i < num_rects; i++) {
+            damaged_area += (uint64_t)(rects[i].x2 - rects[i].x1) * (uint64_t)(rects[i].y2 - rects[i].y1);
+        }
+        if ((double)damaged_area >= config->render.auto_whole_frame_area * (double)output_area) {
+            return "large damage";
+        }
+    }
+
+    // If partial frames haven't been any faster than whole ones, the per-rect overhead is
+    // outweighing the pixels saved, but check again every so often in case that changed
+    int64_t partial_render_nsec = output->damage_governor.partial_render_nsec;
+    int64_t whole_render_nsec = output->damage_governor.whole_render_nsec;
+    if ((partial_render_nsec > 0) && (whole_render_nsec > 0) &&
+        (partial_render_nsec >= whole_render_nsec) &&
+        (output->damage_governor.frames_since_partial < AUTO_DAMAGE_PROBE_INTERVAL)) {
+        return "slow partial frames";
+    }
+
+    return NULL;
+}
+
+/// Decide whether to redraw the whole frame in the auto damage tracking mode, logging any
+/// change from the previous frame
+static bool choose_auto_whole_frame(struct viv_render_frame *frame) {
+    struct viv_output *output = frame->output;
+    const char *reason = get_auto_whole_frame_reason(frame);
+    bool whole_frame = (reason != NULL);
+
+    if (whole_frame != output->damage_governor.whole_frame) {
+        wlr_log(WLR_DEBUG, "Output \"%s\": switching to %s frames (%s)", output->wlr_output->name,
+                whole_frame ? "whole" : "partial", whole_frame ? reason : "small damage");
+        output->damage_governor.whole_frame = whole_frame;
+        output->render_stats.damage_mode_switches++;
+    }
+
+    return whole_frame;
+}
+
+static int64_t moving_average_nsec(int64_t average_nsec, int64_t sample_nsec) {
+    if (average_nsec == 0) {
+        return sample_nsec;
+    }
+    return (average_nsec * 7 + sample_nsec) / 8;
+}
+
+/// Record how long a frame drawn in the auto damage tracking mode took to render
+static void update_damage_governor(struct viv_output *output, bool whole_frame, int64_t render_nsec) {
+    if (whole_frame) {
+        output->damage_governor.whole_render_nsec =
+            moving_average_nsec(output->damage_governor.whole_render_nsec, render_nsec);
+        output->damage_governor.frames_since_partial++;
+    } else {
+        // Start the average again if it is too old to reflect how partial frames now perform
+        bool is_stale = (output->damage_governor.frames_since_partial >= AUTO_DAMAGE_PROBE_INTERVAL);
+        output->damage_governor.partial_render_nsec =
+            moving_average_nsec(is_stale ? 0 : output->damage_governor.partial_render_nsec, render_nsec);
+        output->damage_governor.frames_since_partial = 0;
+    }
+}
+
+/// Redraw the texture caches of views on the output that have stopped changing. Views
+/// whose surfaces committed since the previous attempt are still changing, so they are
+/// drawn surface by surface rather than having their cache redrawn every frame.
+static void update_view_texture_caches(struct viv_output *output) {
+    if (!output->server->config->render.view_texture_cache) {
+        return;
+    }
+
+    collect_render_entries(output);
+
+    float scale = get_render_scale(output);
+    struct viv_render_entry *entry;
+    wl_array_for_each(entry, &output->render_entries) {
+        struct viv_view *view = entry->view;
+        if ((view == NULL) || entry->hidden) {
+            continue;
+        }
+        if (!view->texture_cache.dirty && (view->texture_cache.texture != NULL) &&
+            (view->texture_cache.scale == scale)) {
+            continue;
+        }
+
+        struct viv_texture_cache_data cdata = { 0 };
+        if (!view_wants_texture_cache(view, &cdata)) {
+            release_texture_cache(view);
+            continue;
+        }
+
+        if (view->texture_cache.committed_since_update) {
+            view->texture_cache.committed_since_update = false;
+            continue;
+        }
+
+        if (!redraw_texture_cache(view, &cdata, scale)) {
+            release_texture_cache(view);
+        }
+    }
+}
+
+static void release_reduced_render(struct viv_output *output) {
+    if (output->reduced_render.texture) {
+        wlr_texture_destroy(output->reduced_render.texture);
+        output->reduced_render.texture = NULL;
+    }
+    if (output->reduced_render.buffer) {
+        wlr_buffer_drop(output->reduced_render.buffer);
+        output->reduced_render.buffer = NULL;
+    }
+}
+
+static void release_background_cache(struct viv_output *output) {
+    if (output->background_cache.texture) {
+        wlr_texture_destroy(output->background_cache.texture);
+        output->background_cache.texture = NULL;
+    }
+    if (output->background_cache.buffer) {
+        wlr_buffer_drop(output->background_cache.buffer);
+        output->background_cache.buffer = NULL;
+    }
+}
+
+/// Draw the background image as the given mode places it within the buffer
+static void draw_background_image(struct wlr_renderer *renderer, struct wlr_texture *image,
+                                  enum viv_background_mode mode, struct wlr_buffer *buffer) {
+    float projection[9];
+    wlr_matrix_projection(projection, buffer->width, buffer->height, WL_OUTPUT_TRANSFORM_NORMAL);
+
+    float matrix[9];
+    struct wlr_box box;
+    if (mode == VIV_BACKGROUND_MODE_TILE) {
+        box.width = image->width;
+        box.height = image->height;
+        for (box.y = 0; box.y < buffer->height; box.y += box.height) {
+            for (box.x = 0; box.x < buffer->width; box.x += box.width) {
+                wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0, projection);
+                wlr_render_texture_with_matrix(renderer, image, matrix, 1);
+            }
+        }
+        return;
+    }
+
+    enum viv_geometry_fit fit;
+    switch (mode) {
+    case VIV_BACKGROUND_MODE_STRETCH:
+        fit = VIV_GEOMETRY_FIT_STRETCH;
+        break;
+    case VIV_BACKGROUND_MODE_FILL:
+        fit = VIV_GEOMETRY_FIT_FILL;
+        break;
+    case VIV_BACKGROUND_MODE_FIT:
+        fit = VIV_GEOMETRY_FIT_FIT;
+        break;
+    case VIV_BACKGROUND_MODE_CENTER:
+        fit = VIV_GEOMETRY_FIT_CENTER;
+        break;
+    default:
+        UNREACHABLE();
+        return;
+    }
+    viv_geometry_fit_box(&box, image->width, image->height, buffer->width, buffer->height, fit);
+    wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0, projection);
+    wlr_render_texture_with_matrix(renderer, image, matrix, 1);
+}
+
+/// Draw the background into the output's background cache at the render resolution, if
+/// the image or the resolution has changed since it was last drawn. Like the texture
+/// caches, this must happen before the output's buffer is attached.
+static void update_background_cache(struct wlr_renderer *renderer, struct viv_output *output) {
+    struct viv_server *server = output->server;
+    struct wlr_texture *image = server->background.texture;
+    if (image == NULL) {
+        return;
+    }
+
+    int width, height;
+    get_render_resolution(output, &width, &height);
+    struct wlr_buffer *buffer = output->background_cache.buffer;
+    if (buffer && (buffer->width == width) && (buffer->height == height) &&
+        (output->background_cache.generation == server->background.generation)) {
+        return;
+    }
+
+    release_background_cache(output);
+    buffer = create_texture_cache_buffer(server, width, height);
+    if (buffer == NULL) {
+        wlr_log(WLR_ERROR, "Failed to allocate a %dx%d background for output \"%s\"",
+                width, height, output->wlr_output->name);
+        return;
+    }
+    output->background_cache.buffer = buffer;
+
+    if (!wlr_renderer_begin_with_buffer(renderer, buffer)) {
+        wlr_log(WLR_ERROR, "Failed to start drawing the background for output \"%s\"", output->wlr_output->name);
+        release_background_cache(output);
+        return;
+    }
+    wlr_renderer_scissor(renderer, NULL);
+    wlr_renderer_clear(renderer, viv_background_get_colour(server));
+    draw_background_image(renderer, image, server->background.mode, buffer);
+    wlr_renderer_end(renderer);
+
+    output->background_cache.texture = wlr_texture_from_buffer(renderer, buffer);
+    if (output->background_cache.texture == NULL) {
+        wlr_log(WLR_ERROR, "Failed to make a texture from the background for output \"%s\"",
+                output->wlr_output->name);
+        release_background_cache(output);
+        return;
+    }
+    // Outputs are already damaged whole whenever the image or their resolution changes
+    output->background_cache.generation = server->background.generation;
+}
+
+/// Draw the output's background cache wherever the frame is cleared, returning false if
+/// there is no up to date cache to draw
+static bool draw_background_cache(struct viv_render_frame *frame, pixman_region32_t *clear) {
+    struct wlr_texture *texture = frame->output->background_cache.texture;
+    if ((texture == NULL) ||
+        ((int)texture->width != frame->transformed_width) || ((int)texture->height != frame->transformed_height)) {
+        return false;
+    }
+
+    struct wlr_box box = {
+        .width = frame->transformed_width,
+        .height = frame->transformed_height,
+    };
+    struct wlr_fbox src_box = {
+        .width = texture->width,
+        .height = texture->height,
+    };
+    if (frame->pixman_image &&
+        render_texture_with_pixman(frame, texture, &src_box, &box, WL_OUTPUT_TRANSFORM_NORMAL, clear)) {
+        return true;
+    }
+
+    float matrix[9];
+    wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0, frame->projection);
+
+    int num_rects;
+    pixman_box32_t *rects = pixman_region32_rectangles(clear, &num_rects);
+    for (int i = 0; i < num_rects; i++) {
+        pixman_box32_t rect = rects[i];
+        struct wlr_box rect_box = {
+            .x = rect.x1,
+            .y = rect.y1,
+            .width = rect.x2 - rect.x1,
+            .height = rect.y2 - rect.y1,
+        };
+        scissor_output_box(frame, &rect_box);
+        wlr_render_texture_with_matrix(frame->renderer, texture, matrix, 1);
+    }
+    return true;
+}
+
+void viv_render_output_state_init(struct viv_output *output) {
+    wl_array_init(&output->render_entries);
+    output->render_entries_generation = output->server->render_entries_generation - 1;
+
+    pixman_region32_t *scratch_regions = (pixman_region32_t *)&output->render_scratch;
+    for (size_t i = 0; i < NUM_SCRATCH_REGIONS; i++) {
+        pixman_region32_init(&scratch_regions[i]);
+    }
+}
+
+void viv_render_output_state_fini(struct viv_output *output) {
+    release_reduced_render(output);
+    release_background_cache(output);
+    clear_render_entries(&output->render_entries);
+    wl_array_release(&output->render_entries);
+
+    pixman_region32_t *scratch_regions = (pixman_region32_t *)&output->render_scratch;
+    for (size_t i = 0; i < NUM_SCRATCH_REGIONS; i++) {
+        pixman_region32_fini(&scratch_regions[i]);
+    }
+}
+
+/// Decide whether the frame is redrawn whole, damaging all of it if so, then merge its
+/// damage into fewer rects where that is worthwhile. Returns whether the frame is whole.
+static bool prepare_frame_damage(struct viv_render_frame *frame) {
+    bool whole_frame;
+    if (frame->output->server->config->damage_tracking_mode == VIV_DAMAGE_TRACKING_AUTO) {
+        whole_frame = choose_auto_whole_frame(frame);
+    } else {
+        whole_frame = !output_draws_partial_frames(frame->output);
+    }
+
+    if (whole_frame) {
+        // Damage the full output to ensure it all gets drawn
+        pixman_region32_union_rect(frame->damage, frame->damage, 0, 0,
+                                   frame->transformed_width, frame->transformed_height);
+    }
+
+    coalesce_damage(frame);
+    return whole_frame;
+}
+
+/// Draw the damaged parts of everything on the output into the frame's buffer, which the
+/// renderer must already have begun drawing to
+static void draw_frame(struct viv_render_frame *frame) {
+    struct viv_output *output = frame->output;
+    struct wlr_renderer *renderer = frame->renderer;
+    struct viv_render_scratch *scratch = frame->scratch;
+
+    if (output->server->config->debug_mark_undamaged_regions) {
+        // Clear the output with a solid colour, so that it is easy to
+        // see what rendering has taken place this frame.
+        wlr_renderer_clear(renderer, (float[]){0.95, 0.2, 0.2, 1.0});
+    }
+
+    // Work out what will be drawn, and which parts of it will end up hidden behind opaque
+    // surfaces, so that hidden regions are neither cleared nor drawn
+    output->render_stats.culled_surfaces = 0;
+    collect_render_entries(output);
+
+    pixman_region32_subtract(&scratch->clear, frame->damage, &scratch->total_opaque);
+
+    const float *clear_colour = viv_background_get_colour(output->server);
+    int num_rects;
+    pixman_box32_t *rects = pixman_region32_rectangles(&scratch->clear, &num_rects);
+    if (draw_background_cache(frame, &scratch->clear)) {
+        // The background covers the whole output, so nothing else needs clearing
+    } else if (frame->pixman_image) {
+        if (num_rects > 0) {
+            fill_rects_with_pixman(frame, PIXMAN_OP_SRC, clear_colour, rects, num_rects);
+        }
+    } else {
+        for (int i = 0; i < num_rects; i++) {
+            pixman_box32_t rect = rects[i];
+            struct wlr_box box = {
+                .x = rect.x1,
+                .y = rect.y1,
+                .width = rect.x2 - rect.x1,
+                .height = rect.y2 - rect.y1,
+            };
+            scissor_output_box(frame, &box);
+            wlr_renderer_clear(renderer, clear_colour);
+        }
+    }
+
+    struct viv_render_entry *entry;
+    wl_array_for_each(entry, &output->render_entries) {
+        if (entry->hidden) {
+            if (!output->render_schedule.frame_done_sent &&
+                (viv_view_get_primary_output(entry->view) == output)) {
+                send_hidden_view_frame_done(entry->view, &frame->when);
+            }
+        } else if (entry->view) {
+            viv_render_view(frame, entry->view, &entry->occluded);
+        } else {
+            viv_render_layer_view(frame, entry->layer_view, &entry->occluded);
         }
     }
 
@@ -570,7 +1867,7 @@ void viv_render_output(struct wlr_renderer *renderer, struct viv_output *output)
         };
         float output_marker_colour[4] = {0.5, 0.5, 1, 0.5};
         if (output == output->server->active_output) {
-            wlr_render_rect(renderer, &output_marker_box, output_marker_colour, output->wlr_output->transform_matrix);
+            wlr_render_rect(renderer, &output_marker_box, output_marker_colour, frame->projection);
         }
     }
 
@@ -584,9 +1881,212 @@ void viv_render_output(struct wlr_renderer *renderer, struct viv_output *output)
         struct wlr_box output_marker_box = {
             .x = 30, .y = 0, .width = 10, .height = 10
         };
-        wlr_render_rect(renderer ,&output_marker_box, output_marker_colour, output->wlr_output->transform_matrix);
+        wlr_render_rect(renderer ,&output_marker_box, output_marker_colour, frame->projection);
     }
 #endif
+}
+
+/// Composite the output into its reduced buffer, at its render scale. This must happen
+/// before the output's own buffer is attached, as drawing to another buffer rebinds the
+/// renderer, so what gets redrawn is the damage the output has accumulated since its last
+/// frame. The parts of the output that change once the result is upscaled are added to
+/// the output's damage. Returns false if the reduced buffer couldn't be drawn.
+static bool render_reduced_frame(struct wlr_renderer *renderer, struct viv_output *output, bool *whole_frame) {
+    struct viv_render_scratch *scratch = &output->render_scratch;
+    float render_scale = output->reduced_render.scale;
+
+    // The output's damage is only needed again once its buffer is attached, so its scratch
+    // region is free until then
+    struct viv_render_frame frame = {
+        .output = output,
+        .renderer = renderer,
+        .damage = &scratch->damage,
+        .scratch = scratch,
+        .transform = WL_OUTPUT_TRANSFORM_NORMAL,
+    };
+    clock_gettime(CLOCK_MONOTONIC, &frame.when);
+    get_output_offset(output, &frame.ox, &frame.oy);
+    get_render_resolution(output, &frame.transformed_width, &frame.transformed_height);
+
+    viv_geometry_layout_region_to_output_region(frame.damage, &output->damage->current, 0, 0, render_scale,
+                                                VIV_GEOMETRY_ROUND_OUTWARD, &output->geometry_scratch);
+
+    struct wlr_buffer *buffer = output->reduced_render.buffer;
+    if (buffer && ((buffer->width != frame.transformed_width) || (buffer->height != frame.transformed_height))) {
+        release_reduced_render(output);
+        buffer = NULL;
+    }
+    if (buffer == NULL) {
+        buffer = create_texture_cache_buffer(output->server, frame.transformed_width, frame.transformed_height);
+        if (buffer == NULL) {
+            wlr_log(WLR_ERROR, "Failed to allocate a %dx%d reduced buffer for output \"%s\"",
+                    frame.transformed_width, frame.transformed_height, output->wlr_output->name);
+            return false;
+        }
+        output->reduced_render.buffer = buffer;
+        // A new buffer has no contents worth keeping
+        pixman_region32_union_rect(frame.damage, frame.damage, 0, 0,
+                                   frame.transformed_width, frame.transformed_height);
+    }
+
+    *whole_frame = prepare_frame_damage(&frame);
+
+    if (!wlr_renderer_begin_with_buffer(renderer, buffer)) {
+        wlr_log(WLR_ERROR, "Failed to start drawing the reduced buffer for output \"%s\"", output->wlr_output->name);
+        return false;
+    }
+    if (output->server->software_renderer) {
+        frame.pixman_image = wlr_pixman_renderer_get_current_image(renderer);
+    }
+    wlr_matrix_projection(frame.projection, buffer->width, buffer->height, WL_OUTPUT_TRANSFORM_NORMAL);
+
+    draw_frame(&frame);
+
+    wlr_renderer_end(renderer);
+
+    // As for texture caches, the renderer only picks up the buffer's new contents when a
+    // texture is made from it
+    if (pixman_region32_not_empty(frame.damage) || (output->reduced_render.texture == NULL)) {
+        if (output->reduced_render.texture) {
+            wlr_texture_destroy(output->reduced_render.texture);
+        }
+        output->reduced_render.texture = wlr_texture_from_buffer(renderer, buffer);
+        if (output->reduced_render.texture == NULL) {
+            wlr_log(WLR_ERROR, "Failed to make a texture from the reduced buffer for output \"%s\"",
+                    output->wlr_output->name);
+            return false;
+        }
+    }
+
+    // Upscaling blends each reduced pixel into the output pixels around it, so the output
+    // changes one reduced pixel beyond everything that was redrawn
+    wlr_region_expand(&scratch->frame_damage, frame.damage, 1);
+    viv_geometry_layout_region_to_output_region(frame.damage, &scratch->frame_damage, 0, 0, 1 / render_scale,
+                                                VIV_GEOMETRY_ROUND_OUTWARD, &output->geometry_scratch);
+    wlr_output_damage_add(output->damage, frame.damage);
+
+    return true;
+}
+
+/// Draw the output's reduced buffer onto the output's own buffer, scaled up to fill it,
+/// limited to the frame's damage
+static void upscale_reduced_frame(struct viv_render_frame *frame) {
+    struct wlr_box box = {
+        .width = frame->transformed_width,
+        .height = frame->transformed_height,
+    };
+    float matrix[9];
+    wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0, frame->projection);
+
+    int num_rects;
+    pixman_box32_t *rects = pixman_region32_rectangles(frame->damage, &num_rects);
+    for (int i = 0; i < num_rects; i++) {
+        pixman_box32_t rect = rects[i];
+        struct wlr_box rect_box = {
+            .x = rect.x1,
+            .y = rect.y1,
+            .width = rect.x2 - rect.x1,
+            .height = rect.y2 - rect.y1,
+        };
+        scissor_output_box(frame, &rect_box);
+        wlr_render_texture_with_matrix(frame->renderer, frame->output->reduced_render.texture, matrix, 1);
+    }
+    wlr_renderer_scissor(frame->renderer, NULL);
+}
+
+void viv_render_output(struct wlr_renderer *renderer, struct viv_output *output) {
+    bool was_scanned_out = output->render_stats.scanout_active;
+    enum scanout_result scanout_result = scan_out_fullscreen_view(output);
+    if (scanout_result == SCANOUT_NOTHING_TO_DO) {
+        // Keep showing the buffer already scanned out
+        return;
+    }
+    output->render_stats.scanout_active = (scanout_result == SCANOUT_DONE);
+    if (output->render_stats.scanout_active != was_scanned_out) {
+        wlr_log(WLR_INFO, "Output \"%s\": %s direct scanout of fullscreen view", output->wlr_output->name,
+                output->render_stats.scanout_active ? "starting" : "stopping");
+        output->render_stats.scanout_switches++;
+    }
+    if (output->render_stats.scanout_active) {
+        output->render_stats.scanout_frames++;
+        return;
+    }
+    if (was_scanned_out) {
+        // The renderer's buffers are out of date after scanning out a client buffer
+        viv_output_damage(output);
+    }
+
+    // Texture caches must be drawn before the output's buffer is attached for rendering, as
+    // drawing to them rebinds the renderer
+    update_view_texture_caches(output);
+    update_background_cache(renderer, output);
+
+    // Remember where the scratch regions' storage is, to count any allocations made while
+    // rendering the frame
+    struct viv_render_scratch *scratch = &output->render_scratch;
+    pixman_region32_t *scratch_regions = (pixman_region32_t *)scratch;
+    pixman_region32_data_t *scratch_data[NUM_SCRATCH_REGIONS];
+    for (size_t i = 0; i < NUM_SCRATCH_REGIONS; i++) {
+        scratch_data[i] = scratch_regions[i].data;
+    }
+    size_t entries_alloc = output->render_entries.alloc;
+    uint32_t geometry_allocations = output->geometry_scratch.allocations;
+    output->render_stats.allocations = 0;
+
+    // Likewise the reduced buffer must be drawn before the output's buffer is attached
+    struct timespec render_start;
+    clock_gettime(CLOCK_MONOTONIC, &render_start);
+    bool whole_frame = false;
+    if (output_has_reduced_render(output) && !render_reduced_frame(renderer, output, &whole_frame)) {
+        wlr_log(WLR_ERROR, "Compositing output \"%s\" at full resolution from now on", output->wlr_output->name);
+        release_reduced_render(output);
+        output->reduced_render.scale = 1;
+        viv_output_damage(output);
+    }
+
+    pixman_region32_t *damage = &scratch->damage;
+    bool needs_frame;
+    bool attach_render_success = wlr_output_damage_attach_render(output->damage, &needs_frame, damage);
+    if (!attach_render_success) {
+        return;
+    }
+    if (!needs_frame) {
+        wlr_output_rollback(output->wlr_output);
+        return;
+    }
+
+    struct viv_render_frame frame = {
+        .output = output,
+        .renderer = renderer,
+        .damage = damage,
+        .scratch = scratch,
+        .transform = output->wlr_output->transform,
+    };
+    clock_gettime(CLOCK_MONOTONIC, &frame.when);
+    get_output_offset(output, &frame.ox, &frame.oy);
+    wlr_output_transformed_resolution(output->wlr_output, &frame.transformed_width, &frame.transformed_height);
+    memcpy(frame.projection, output->wlr_output->transform_matrix, sizeof(frame.projection));
+
+    if (!output_has_reduced_render(output)) {
+        render_start = frame.when;
+        whole_frame = prepare_frame_damage(&frame);
+    }
+    output->render_stats.whole_frame = whole_frame;
+
+    /* Begin the renderer (calls glViewport and some other GL sanity checks). The viewport
+     * covers the whole buffer, whatever the output's scale or transform. */
+    wlr_renderer_begin(renderer, output->wlr_output->width, output->wlr_output->height);
+
+    if (output_has_reduced_render(output)) {
+        upscale_reduced_frame(&frame);
+    } else {
+        // The software renderer's buffer can be drawn to directly when output coordinates
+        // are also buffer coordinates, which skips its per-rect compositing of whole textures
+        if (output->server->software_renderer && (frame.transform == WL_OUTPUT_TRANSFORM_NORMAL)) {
+            frame.pixman_image = wlr_pixman_renderer_get_current_image(renderer);
+        }
+        draw_frame(&frame);
+    }
 
     // Have wlroots render software cursors if necessary (does nothing
     // if hardware cursors available)
@@ -596,23 +2096,29 @@ void viv_render_output(struct wlr_renderer *renderer, struct viv_output *output)
     wlr_renderer_end(renderer);
 
     // Calculate the frame damage before swapping the buffers
-    pixman_region32_t frame_damage;
-    pixman_region32_init(&frame_damage);
-
-    // Fill in frame damage
-    struct wlr_output *wlr_output = output->wlr_output;
-    int fwidth, fheight;
-    wlr_output_transformed_resolution(wlr_output, &fwidth, &fheight);
-    enum wl_output_transform transform = wlr_output_transform_invert(wlr_output->transform);
-    wlr_region_transform(&frame_damage, &output->damage->current, transform, fwidth, fheight);
+    set_output_frame_damage(output);
 
-    wlr_output_set_damage(output->wlr_output, &frame_damage);
-    pixman_region32_fini(&frame_damage);
-
-    pixman_region32_fini(&damage);
+    for (size_t i = 0; i < NUM_SCRATCH_REGIONS; i++) {
+        if (region_was_allocated(&scratch_regions[i], scratch_data[i])) {
+            output->render_stats.allocations++;
+        }
+    }
+    if (output->render_entries.alloc != entries_alloc) {
+        output->render_stats.allocations++;
+    }
+    output->render_stats.allocations += output->geometry_scratch.allocations - geometry_allocations;
 
     // Swap the buffers
-    wlr_output_commit(output->wlr_output);
+    viv_output_commit(output, &output->damage->current);
+
+    enum viv_damage_tracking_mode damage_tracking_mode = output->server->config->damage_tracking_mode;
+    if (damage_tracking_mode == VIV_DAMAGE_TRACKING_AUTO) {
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        int64_t render_nsec = (int64_t)(end.tv_sec - render_start.tv_sec) * NSEC_PER_SEC +
+            (end.tv_nsec - render_start.tv_nsec);
+        update_damage_governor(output, whole_frame, render_nsec);
+    }
 
     struct viv_server *server = output->server;
     if (server->config->damage_tracking_mode == VIV_DAMAGE_TRACKING_NONE) {
@@ -620,3 +2126,115 @@ void viv_render_output(struct wlr_renderer *renderer, struct viv_output *output)
         viv_output_damage(output);
     }
 }
+
+/// Fill the part of the frame's damage outside the given box, in output coordinates, with
+/// the given colour
+static void clear_outside_box(struct viv_render_frame *frame, struct wlr_box *box, const float colour[static 4]) {
+    pixman_region32_t *inside = &frame->scratch->visible_damage;
+    pixman_region32_t *outside = &frame->scratch->clear;
+    pixman_region32_clear(inside);
+    pixman_region32_union_rect(inside, inside, box->x, box->y, box->width, box->height);
+    pixman_region32_subtract(outside, frame->damage, inside);
+
+    int num_rects;
+    pixman_box32_t *rects = pixman_region32_rectangles(outside, &num_rects);
+    for (int i = 0; i < num_rects; i++) {
+        pixman_box32_t rect = rects[i];
+        struct wlr_box rect_box = {
+            .x = rect.x1,
+            .y = rect.y1,
+            .width = rect.x2 - rect.x1,
+            .height = rect.y2 - rect.y1,
+        };
+        scissor_output_box(frame, &rect_box);
+        wlr_renderer_clear(frame->renderer, colour);
+    }
+    wlr_renderer_scissor(frame->renderer, NULL);
+}
+
+/// Draw the source's latest buffer into the given box of the mirror's frame, undoing the
+/// source's transform and scaling it to fit
+static void draw_mirror_source(struct viv_render_frame *frame, struct wlr_texture *texture, struct wlr_box *box) {
+    struct viv_output *source = frame->output->mirror.source;
+    enum wl_output_transform transform = wlr_output_transform_invert(source->wlr_output->transform);
+    float matrix[9];
+    wlr_matrix_project_box(matrix, box, transform, 0, frame->projection);
+
+    pixman_region32_t *visible = &frame->scratch->visible_damage;
+    pixman_region32_intersect_rect(visible, frame->damage, box->x, box->y, box->width, box->height);
+
+    int num_rects;
+    pixman_box32_t *rects = pixman_region32_rectangles(visible, &num_rects);
+    for (int i = 0; i < num_rects; i++) {
+        pixman_box32_t rect = rects[i];
+        struct wlr_box rect_box = {
+            .x = rect.x1,
+            .y = rect.y1,
+            .width = rect.x2 - rect.x1,
+            .height = rect.y2 - rect.y1,
+        };
+        scissor_output_box(frame, &rect_box);
+        wlr_render_texture_with_matrix(frame->renderer, texture, matrix, 1);
+    }
+    wlr_renderer_scissor(frame->renderer, NULL);
+}
+
+void viv_render_mirror_output(struct wlr_renderer *renderer, struct viv_output *output) {
+    ASSERT(output->mirror.is_mirror);
+
+    struct viv_render_scratch *scratch = &output->render_scratch;
+    pixman_region32_t *damage = &scratch->damage;
+    bool needs_frame;
+    if (!wlr_output_damage_attach_render(output->damage, &needs_frame, damage)) {
+        return;
+    }
+    if (!needs_frame) {
+        wlr_output_rollback(output->wlr_output);
+        return;
+    }
+
+    struct viv_render_frame frame = {
+        .output = output,
+        .renderer = renderer,
+        .damage = damage,
+        .scratch = scratch,
+        .transform = output->wlr_output->transform,
+    };
+    clock_gettime(CLOCK_MONOTONIC, &frame.when);
+    wlr_output_transformed_resolution(output->wlr_output, &frame.transformed_width, &frame.transformed_height);
+    memcpy(frame.projection, output->wlr_output->transform_matrix, sizeof(frame.projection));
+
+    // Until the source exists and has committed a frame, there is nothing to show
+    struct viv_output *source = output->mirror.source;
+    struct wlr_texture *texture = NULL;
+    struct wlr_box box = { 0 };
+    if (source && source->mirror.buffer) {
+        // The texture is kept with the source's buffer, for every mirror to share until the
+        // source commits another
+        if (source->mirror.texture == NULL) {
+            source->mirror.texture = wlr_texture_from_buffer(renderer, source->mirror.buffer);
+        }
+        texture = source->mirror.texture;
+        if (texture == NULL) {
+            wlr_log(WLR_ERROR, "Output \"%s\": could not make a texture from \"%s\"'s buffer",
+                    output->wlr_output->name, source->wlr_output->name);
+        }
+    }
+    if (texture) {
+        viv_output_get_mirror_box(output, &box);
+    }
+
+    wlr_renderer_begin(renderer, output->wlr_output->width, output->wlr_output->height);
+
+    float black[4] = {0, 0, 0, 1};
+    clear_outside_box(&frame, &box, black);
+    if (texture) {
+        draw_mirror_source(&frame, texture, &box);
+    }
+
+    wlr_output_render_software_cursors(output->wlr_output, NULL);
+    wlr_renderer_end(renderer);
+
+    set_output_frame_damage(output);
+    wlr_output_commit(output->wlr_output);
+}
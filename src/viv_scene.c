@@ -0,0 +1,352 @@
+#include <time.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+
+#include "viv_background.h"
+#include "viv_config_support.h"
+#include "viv_render.h"
+#include "viv_scene.h"
+#include "viv_types.h"
+#include "viv_view.h"
+
+#define NUM_SCENE_BORDERS 4
+
+/// Data for bringing the scene graph up to date from every output's render entries
+struct viv_scene_sync_data {
+    struct viv_server *server;
+    uint32_t generation;
+    struct wlr_scene_node *previous[VIV_SCENE_LAYER_MAX];  // the node most recently stacked in each layer
+};
+
+void viv_scene_init(struct viv_server *server) {
+    server->scene = wlr_scene_create();
+    CHECK_ALLOCATION(server->scene);
+
+    // Created bottom to top, so the trees are already stacked in order
+    for (size_t i = 0; i < VIV_SCENE_LAYER_MAX; i++) {
+        server->scene_layers[i] = wlr_scene_tree_create(&server->scene->node);
+        CHECK_ALLOCATION(server->scene_layers[i]);
+    }
+
+    // Scene outputs follow their outputs' positions in the layout
+    wlr_scene_attach_output_layout(server->scene, server->output_layout);
+    wlr_scene_set_presentation(server->scene, server->presentation);
+}
+
+void viv_scene_output_init(struct viv_output *output) {
+    struct viv_server *server = output->server;
+    float black[4] = {0, 0, 0, 1};
+
+    output->scene_output = wlr_scene_output_create(server->scene, output->wlr_output);
+    CHECK_ALLOCATION(output->scene_output);
+
+    // Both rects are sized and positioned when the scene is synced with the output
+    output->scene_background = wlr_scene_rect_create(&server->scene_layers[VIV_SCENE_LAYER_CLEAR]->node,
+                                                     0, 0, viv_background_get_colour(server));
+    CHECK_ALLOCATION(output->scene_background);
+    output->scene_fullscreen_fill = wlr_scene_rect_create(&server->scene_layers[VIV_SCENE_LAYER_FULLSCREEN]->node,
+                                                          0, 0, black);
+    CHECK_ALLOCATION(output->scene_fullscreen_fill);
+    wlr_scene_node_set_enabled(&output->scene_fullscreen_fill->node, false);
+}
+
+void viv_scene_output_fini(struct viv_output *output) {
+    // The scene output itself is destroyed by wlroots along with the wlr_output
+    wlr_scene_node_destroy(&output->scene_background->node);
+    wlr_scene_node_destroy(&output->scene_fullscreen_fill->node);
+    output->scene_output = NULL;
+}
+
+void viv_scene_view_map(struct viv_view *view) {
+    ASSERT(view->scene.tree == NULL);
+    struct viv_server *server = view->server;
+
+    // Moved to the right layer when the view is first drawn
+    view->scene.tree = wlr_scene_tree_create(&server->scene_layers[VIV_SCENE_LAYER_TILED]->node);
+    CHECK_ALLOCATION(view->scene.tree);
+    wlr_scene_node_set_enabled(&view->scene.tree->node, false);
+
+    float *colour = server->config->inactive_border_colour;
+    for (size_t i = 0; i < NUM_SCENE_BORDERS; i++) {
+        view->scene.borders[i] = wlr_scene_rect_create(&view->scene.tree->node, 0, 0, colour);
+        CHECK_ALLOCATION(view->scene.borders[i]);
+        wlr_scene_node_set_enabled(&view->scene.borders[i]->node, false);
+    }
+
+    switch (view->type) {
+    case VIV_VIEW_TYPE_XDG_SHELL:
+        // The xdg surface node also keeps track of the view's popups' nodes
+        view->scene.surface = wlr_scene_xdg_surface_create(&view->scene.tree->node, view->xdg_surface);
+        break;
+#ifdef XWAYLAND
+    case VIV_VIEW_TYPE_XWAYLAND:
+        view->scene.surface = wlr_scene_subsurface_tree_create(&view->scene.tree->node,
+                                                               view->xwayland_surface->surface);
+        break;
+#endif
+    default:
+        UNREACHABLE();
+    }
+    CHECK_ALLOCATION(view->scene.surface);
+}
+
+void viv_scene_view_unmap(struct viv_view *view) {
+    if (view->scene.tree == NULL) {
+        return;
+    }
+
+    // Also destroys the nodes of any popups, see handle_popup_scene_node_destroy
+    wlr_scene_node_destroy(&view->scene.tree->node);
+    view->scene.tree = NULL;
+    view->scene.surface = NULL;
+    for (size_t i = 0; i < NUM_SCENE_BORDERS; i++) {
+        view->scene.borders[i] = NULL;
+    }
+}
+
+void viv_scene_layer_view_map(struct viv_layer_view *layer_view) {
+    ASSERT(layer_view->scene_node == NULL);
+    struct viv_server *server = layer_view->server;
+
+    // Moved to the right layer when the layer view is first drawn
+    layer_view->scene_node = wlr_scene_subsurface_tree_create(&server->scene_layers[VIV_SCENE_LAYER_BACKGROUND]->node,
+                                                              layer_view->layer_surface->surface);
+    CHECK_ALLOCATION(layer_view->scene_node);
+    wlr_scene_node_set_enabled(layer_view->scene_node, false);
+}
+
+void viv_scene_layer_view_unmap(struct viv_layer_view *layer_view) {
+    if (layer_view->scene_node == NULL) {
+        return;
+    }
+
+    wlr_scene_node_destroy(layer_view->scene_node);
+    layer_view->scene_node = NULL;
+}
+
+static void handle_popup_scene_node_destroy(struct wl_listener *listener, void *data) {
+    UNUSED(data);
+    struct viv_xdg_popup *popup = wl_container_of(listener, popup, scene_node_destroy);
+    wl_list_remove(&popup->scene_node_destroy.link);
+    popup->scene_node = NULL;
+}
+
+void viv_scene_popup_map(struct viv_xdg_popup *popup) {
+    if (popup->scene_node) {
+        // Remapped, wlroots shows the existing node again
+        return;
+    }
+
+    struct wlr_scene_node *parent_node = *popup->parent_scene_node;
+    if (parent_node == NULL) {
+        wlr_log(WLR_ERROR, "Cannot add popup %p to the scene, its parent has no scene node", popup);
+        return;
+    }
+
+    popup->scene_node = wlr_scene_xdg_surface_create(parent_node, popup->wlr_popup->base);
+    CHECK_ALLOCATION(popup->scene_node);
+
+    // The node is destroyed along with its parent's node, or by wlroots when the popup is
+    // destroyed, whichever comes first
+    popup->scene_node_destroy.notify = handle_popup_scene_node_destroy;
+    wl_signal_add(&popup->scene_node->events.destroy, &popup->scene_node_destroy);
+}
+
+void viv_scene_popup_destroy(struct viv_xdg_popup *popup) {
+    if (popup->scene_node == NULL) {
+        return;
+    }
+
+    // Leave the node itself for wlroots to clean up
+    wl_list_remove(&popup->scene_node_destroy.link);
+    popup->scene_node = NULL;
+}
+
+/// Show the view's borders around its target box, matching the custom renderer
+static void sync_view_borders(struct viv_view *view) {
+    struct viv_server *server = view->server;
+
+    int num_rects = 0;
+    pixman_box32_t *rects = NULL;
+    if ((view->workspace->fullscreen_view != view) && viv_view_draws_borders(view)) {
+        rects = pixman_region32_rectangles(viv_view_get_border_region(view), &num_rects);
+    }
+
+    // A view is drawn just once in the scene, even if it overlaps several outputs, but it
+    // can only be active on the active output anyway
+    bool is_active = ((server->active_output != NULL) &&
+                      viv_view_is_active_on_output(view, server->active_output));
+    float *colour = is_active ? server->config->active_border_colour : server->config->inactive_border_colour;
+
+    for (int i = 0; i < NUM_SCENE_BORDERS; i++) {
+        struct wlr_scene_rect *border = view->scene.borders[i];
+        if (i >= num_rects) {
+            wlr_scene_node_set_enabled(&border->node, false);
+            continue;
+        }
+
+        // The border region is in layout coords, but the rects are within the view's tree
+        pixman_box32_t *rect = &rects[i];
+        wlr_scene_node_set_position(&border->node, rect->x1 - view->x, rect->y1 - view->y);
+        wlr_scene_rect_set_size(border, rect->x2 - rect->x1, rect->y2 - rect->y1);
+        wlr_scene_rect_set_color(border, colour);
+        wlr_scene_node_set_enabled(&border->node, true);
+    }
+}
+
+/// Move the node into the given layer of the scene, directly above the node stacked there
+/// before it, and show it. Nothing is changed, and so nothing is damaged, if the node is
+/// already in place.
+static void stack_node(struct viv_scene_sync_data *sdata, struct wlr_scene_node *node, enum viv_scene_layer layer) {
+    wlr_scene_node_reparent(node, &sdata->server->scene_layers[layer]->node);
+
+    struct wlr_scene_node *previous = sdata->previous[layer];
+    if (previous) {
+        wlr_scene_node_place_above(node, previous);
+    } else {
+        wlr_scene_node_lower_to_bottom(node);
+    }
+    sdata->previous[layer] = node;
+
+    wlr_scene_node_set_enabled(node, true);
+}
+
+static enum viv_scene_layer get_view_scene_layer(struct viv_view *view) {
+    if (view->workspace->fullscreen_view == view) {
+        return VIV_SCENE_LAYER_FULLSCREEN;
+    }
+    return view->is_floating ? VIV_SCENE_LAYER_FLOATING : VIV_SCENE_LAYER_TILED;
+}
+
+static enum viv_scene_layer get_layer_view_scene_layer(struct viv_layer_view *layer_view) {
+    switch (layer_view->layer_surface->current.layer) {
+    case ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND:
+        return VIV_SCENE_LAYER_BACKGROUND;
+    case ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM:
+        return VIV_SCENE_LAYER_BOTTOM;
+    case ZWLR_LAYER_SHELL_V1_LAYER_TOP:
+        return VIV_SCENE_LAYER_TOP;
+    case ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY:
+        return VIV_SCENE_LAYER_OVERLAY;
+    default:
+        UNREACHABLE();
+    }
+    return VIV_SCENE_LAYER_BACKGROUND;
+}
+
+static void sync_view(struct viv_view *view, struct viv_scene_sync_data *sdata) {
+    // Floating views are in the render entries of every output, but are only stacked once
+    if (!view->mapped || (view->scene.tree == NULL) || (view->scene.sync_generation == sdata->generation)) {
+        return;
+    }
+    view->scene.sync_generation = sdata->generation;
+
+    struct wlr_scene_node *node = &view->scene.tree->node;
+    wlr_scene_node_set_position(node, view->x, view->y);
+    stack_node(sdata, node, get_view_scene_layer(view));
+
+    if (view->type == VIV_VIEW_TYPE_XDG_SHELL) {
+        // The xdg surface node is placed at the window geometry, but the view's position
+        // is that of its main surface
+        struct wlr_box geo_box;
+        wlr_xdg_surface_get_geometry(view->xdg_surface, &geo_box);
+        wlr_scene_node_set_position(view->scene.surface, geo_box.x, geo_box.y);
+    }
+
+    sync_view_borders(view);
+}
+
+static void sync_layer_view(struct viv_layer_view *layer_view, struct viv_scene_sync_data *sdata) {
+    if (!layer_view->mapped || (layer_view->scene_node == NULL)) {
+        return;
+    }
+    layer_view->scene_sync_generation = sdata->generation;
+
+    struct wlr_scene_node *node = layer_view->scene_node;
+    wlr_scene_node_set_position(node, layer_view->x, layer_view->y);
+    stack_node(sdata, node, get_layer_view_scene_layer(layer_view));
+}
+
+static void sync_render_entry(struct viv_view *view, struct viv_layer_view *layer_view, void *data) {
+    struct viv_scene_sync_data *sdata = data;
+    if (view) {
+        sync_view(view, sdata);
+    } else {
+        sync_layer_view(layer_view, sdata);
+    }
+}
+
+/// Stack everything drawn on the output in its scene layers, in render order
+static void sync_output(struct viv_output *output, struct viv_scene_sync_data *sdata) {
+    struct wlr_box *output_box = wlr_output_layout_get_box(output->server->output_layout, output->wlr_output);
+    if (output_box == NULL) {
+        return;
+    }
+
+    struct wlr_scene_rect *background = output->scene_background;
+    wlr_scene_node_set_position(&background->node, output_box->x, output_box->y);
+    wlr_scene_rect_set_size(background, output_box->width, output_box->height);
+    wlr_scene_rect_set_color(background, viv_background_get_colour(output->server));
+
+    // The fill goes directly below the fullscreen view, which is stacked next
+    struct wlr_scene_rect *fullscreen_fill = output->scene_fullscreen_fill;
+    struct viv_view *fullscreen_view = output->current_workspace->fullscreen_view;
+    if (fullscreen_view && fullscreen_view->mapped && fullscreen_view->scene.tree) {
+        wlr_scene_node_set_position(&fullscreen_fill->node, output_box->x, output_box->y);
+        wlr_scene_rect_set_size(fullscreen_fill, output_box->width, output_box->height);
+        stack_node(sdata, &fullscreen_fill->node, VIV_SCENE_LAYER_FULLSCREEN);
+    } else {
+        wlr_scene_node_set_enabled(&fullscreen_fill->node, false);
+    }
+
+    viv_render_for_each_entry(output, sync_render_entry, sdata);
+}
+
+/// Bring the whole scene graph up to date. The scene is shared by every output, so all of
+/// them are synced before any is drawn.
+static void sync_scene(struct viv_server *server) {
+    struct viv_scene_sync_data sdata = {
+        .server = server,
+        .generation = ++server->scene_sync_generation,
+    };
+
+    struct viv_output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        sync_output(output, &sdata);
+    }
+
+    // Hide anything that isn't drawn on any output, e.g. views on hidden workspaces
+    struct viv_workspace *workspace;
+    wl_list_for_each(workspace, &server->workspaces, server_link) {
+        struct viv_view *view;
+        wl_list_for_each(view, &workspace->views, workspace_link) {
+            if ((view->scene.tree != NULL) && (view->scene.sync_generation != sdata.generation)) {
+                wlr_scene_node_set_enabled(&view->scene.tree->node, false);
+            }
+        }
+    }
+    wl_list_for_each(output, &server->outputs, link) {
+        struct viv_layer_view *layer_view;
+        wl_list_for_each(layer_view, &output->layer_views, output_link) {
+            if ((layer_view->scene_node != NULL) && (layer_view->scene_sync_generation != sdata.generation)) {
+                wlr_scene_node_set_enabled(layer_view->scene_node, false);
+            }
+        }
+    }
+}
+
+void viv_scene_render_output(struct viv_output *output) {
+    sync_scene(output->server);
+
+    if (!wlr_scene_output_commit(output->scene_output)) {
+        wlr_log(WLR_ERROR, "Output \"%s\": failed to commit scene", output->wlr_output->name);
+    }
+
+    // Clients may have been told to draw already, if this render was delayed
+    if (!output->render_schedule.frame_done_sent) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        wlr_scene_output_send_frame_done(output->scene_output, &now);
+    }
+}
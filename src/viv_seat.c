@@ -8,6 +8,7 @@
 
 #include "viv_cursor.h"
 #include "viv_config_support.h"
+#include "viv_output.h"
 #include "viv_seat.h"
 #include "viv_server.h"
 #include "viv_types.h"
@@ -60,6 +61,16 @@ static void keyboard_handle_modifiers(struct wl_listener *listener, void *data)
 		&keyboard->device->keyboard->modifiers);
 }
 
+/// Report user input, to idle clients and to outputs that lower their refresh rate while idle
+static void notify_activity(struct viv_seat *seat) {
+    wlr_idle_notify_activity(seat->server->idle, seat->wlr_seat);
+
+    struct viv_output *output;
+    wl_list_for_each(output, &seat->server->outputs, link) {
+        viv_output_notify_activity(output);
+    }
+}
+
 /// Handle a key press event
 static void keyboard_handle_key(struct wl_listener *listener, void *data) {
 	struct viv_keyboard *keyboard = wl_container_of(listener, keyboard, key);
@@ -67,7 +78,7 @@ static void keyboard_handle_key(struct wl_listener *listener, void *data) {
 	struct wlr_event_keyboard_key *event = data;
 	struct viv_seat *seat = keyboard->seat;
 
-    wlr_idle_notify_activity(seat->server->idle, seat->wlr_seat);
+    notify_activity(seat);
 
 	// Translate libinput keycode -> xkbcommon
 	uint32_t keycode = event->keycode + 8;
@@ -343,7 +354,7 @@ static void seat_cursor_motion(struct wl_listener *listener, void *data) {
     struct viv_seat *seat = wl_container_of(listener, seat, cursor_motion);
 	struct wlr_event_pointer_motion *event = data;
 
-    wlr_idle_notify_activity(seat->server->idle, seat->wlr_seat);
+    notify_activity(seat);
 
     // Pass the movement along (i.e. allow the cursor to actually move)
 	wlr_cursor_move(seat->cursor, event->device,
@@ -359,7 +370,7 @@ static void seat_cursor_motion_absolute(struct wl_listener *listener, void *data
     struct viv_seat *seat = wl_container_of(listener, seat, cursor_motion_absolute);
 	struct wlr_event_pointer_motion_absolute *event = data;
 
-    wlr_idle_notify_activity(seat->server->idle, seat->wlr_seat);
+    notify_activity(seat);
 
 	wlr_cursor_warp_absolute(seat->cursor, event->device, event->x, event->y);
 	viv_cursor_process_cursor_motion(seat, event->time_msec);
@@ -376,7 +387,7 @@ static void seat_cursor_button(struct wl_listener *listener, void *data) {
 	struct wlr_surface *surface;
 	struct viv_view *view = viv_server_view_at(server, seat->cursor->x, seat->cursor->y, &surface, &sx, &sy);
 
-    wlr_idle_notify_activity(seat->server->idle, seat->wlr_seat);
+    notify_activity(seat);
 
     // TODO: check for layer views to click on
 
@@ -418,7 +429,7 @@ static void seat_cursor_axis(struct wl_listener *listener, void *data) {
     struct viv_seat *seat = wl_container_of(listener, seat, cursor_axis);
 	struct wlr_event_pointer_axis *event = data;
 
-    wlr_idle_notify_activity(seat->server->idle, seat->wlr_seat);
+    notify_activity(seat);
 
 	/* Notify the client with pointer focus of the axis event. */
 	wlr_seat_pointer_notify_axis(seat->wlr_seat,
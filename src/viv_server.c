@@ -7,14 +7,16 @@
 #include <wayland-server-core.h>
 #include <libinput.h>
 #include <wlr/backend.h>
-#ifdef HEADLESS_TEST
+#if defined(HEADLESS_TEST) || defined(HEADLESS_BENCHMARK)
 #include <wlr/backend/headless.h>
 #endif
 #include <wlr/backend/libinput.h>
 #include <wlr/render/allocator.h>
+#include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_data_device.h>
+#include <wlr/types/wlr_export_dmabuf_v1.h>
 #include <wlr/types/wlr_input_device.h>
 #include <wlr/types/wlr_keyboard.h>
 #include <wlr/types/wlr_matrix.h>
@@ -23,7 +25,9 @@
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_output_power_management_v1.h>
 #include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_presentation_time.h>
 #include <wlr/types/wlr_server_decoration.h>
+#include <wlr/types/wlr_viewporter.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/types/wlr_input_inhibitor.h>
 #include <wlr/types/wlr_xdg_decoration_v1.h>
@@ -50,6 +54,7 @@
 #include "viv_workspace.h"
 #include "viv_layout.h"
 #include "viv_output.h"
+#include "viv_output_mode.h"
 #include "viv_render.h"
 #include "viv_seat.h"
 #include "viv_toml_config.h"
@@ -61,6 +66,10 @@
 #include "viv_xwayland_shell.h"
 #endif
 
+#ifdef SCENE_RENDERER
+#include "viv_scene.h"
+#endif
+
 #include "viv_debug_support.h"
 #include "viv_config.h"
 #include "viv_config_support.h"
@@ -203,11 +212,18 @@ static void server_new_output(struct wl_listener *listener, void *data) {
 
     wlr_output_init_render(wlr_output, server->allocator, server->renderer);
 
-    // Use the monitor's preferred mode for now
-    // TODO: Make this configuarble
-	if (!wl_list_empty(&wlr_output->modes)) {
-		struct wlr_output_mode *mode = wlr_output_preferred_mode(wlr_output);
-		wlr_output_set_mode(wlr_output, mode);
+    // Use the configured mode, or else the monitor's preferred mode
+    struct viv_output_config *output_config = viv_output_find_config(server, wlr_output);
+    struct viv_output_mode_spec mode_spec = { .kind = VIV_OUTPUT_MODE_PREFERRED };
+    if (output_config && !viv_output_mode_parse(output_config->mode, &mode_spec)) {
+        wlr_log(WLR_ERROR, "Output \"%s\": invalid mode \"%s\", using the preferred mode",
+                wlr_output->name, output_config->mode);
+    }
+    struct viv_output_mode_choice mode;
+	if (viv_output_mode_choose(&wlr_output->modes, &mode_spec, &mode)) {
+        wlr_log(WLR_INFO, "Output \"%s\": using %s mode %dx%d at %d mHz", wlr_output->name,
+                mode.mode ? "advertised" : "custom", mode.width, mode.height, mode.refresh);
+		viv_output_mode_set(wlr_output, &mode);
 		wlr_output_enable(wlr_output, true);
 		if (!wlr_output_commit(wlr_output)) {
 			return;
@@ -221,7 +237,7 @@ static void server_new_output(struct wl_listener *listener, void *data) {
     viv_output_init(output, server, wlr_output);
 
     // If there isn't already an active output, we may as well use this one
-    if (!server->active_output) {
+    if (!server->active_output && !output->mirror.is_mirror) {
         viv_output_make_active(output);
     }
 }
@@ -289,6 +305,12 @@ static void server_new_layer_surface(struct wl_listener *listener, void *data) {
             layer_surface->output = NULL;
             wlr_layer_surface_v1_destroy(layer_surface);
         }
+    } else if (!viv_output_of_wlr_output(server, layer_surface->output)) {
+        // Mirror outputs only show their source output's frames
+        wlr_log(WLR_ERROR, "Closing new layer surface as its output \"%s\" is a mirror",
+                layer_surface->output->name);
+        wlr_layer_surface_v1_destroy(layer_surface);
+        return;
     }
 
     struct wlr_layer_surface_v1_state *state = &layer_surface->current;
@@ -591,8 +613,7 @@ static void handle_input_inhibit_deactivate(struct wl_listener *listener, void *
 }
 
 static void handle_output_power_manager_set_mode(struct wl_listener *listener, void *data) {
-    UNUSED(listener);
-
+    struct viv_server *server = wl_container_of(listener, server, output_power_manager_set_mode);
     struct wlr_output_power_v1_set_mode_event *event = data;
     bool enabling = event->mode == ZWLR_OUTPUT_POWER_V1_MODE_ON;
 
@@ -601,6 +622,12 @@ static void handle_output_power_manager_set_mode(struct wl_listener *listener, v
     wlr_output_enable(event->output, enabling);
     if (!wlr_output_commit(event->output)) {
         wlr_log(WLR_ERROR, "Failed to commit %s power mode with value %d", event->output->name, enabling);
+        return;
+    }
+
+    struct viv_output *output = viv_output_of_wlr_output(server, event->output);
+    if (output) {
+        viv_output_set_powered(output, enabling);
     }
 }
 
@@ -642,8 +669,8 @@ void viv_server_init(struct viv_server *server) {
 
     // Create a wlroots backend. This will automatically handle creating a suitable
     // backend for the environment, e.g. an X11 window if running under X.
-#ifdef HEADLESS_TEST
-    // Use a headless backend for CI testing without any actual outputs
+#if defined(HEADLESS_TEST) || defined(HEADLESS_BENCHMARK)
+    // Use a headless backend for CI testing and benchmarks without any actual outputs
 
 	server->backend = wlr_headless_backend_create(server->wl_display);
 #else
@@ -655,27 +682,61 @@ void viv_server_init(struct viv_server *server) {
         EXIT_WITH_MESSAGE("Failed to create server backend");
     }
 
-    // Init the default wlroots GLES2 renderer
-	server->renderer = wlr_renderer_autocreate(server->backend);
+    if (server->user_requested_software_renderer) {
+        config->render.renderer = VIV_RENDERER_PIXMAN;
+    }
+
+    // Init the configured renderer, by default letting wlroots choose (usually GLES2)
+    switch (config->render.renderer) {
+    case VIV_RENDERER_AUTO:
+        server->renderer = wlr_renderer_autocreate(server->backend);
+        break;
+    case VIV_RENDERER_PIXMAN:
+        wlr_log(WLR_INFO, "Using the pixman software renderer");
+        server->renderer = wlr_pixman_renderer_create();
+        break;
+    default:
+        UNREACHABLE();
+    }
+    if (!server->renderer) {
+        EXIT_WITH_MESSAGE("Failed to create renderer");
+    }
 	wlr_renderer_init_wl_display(server->renderer, server->wl_display);
 
+    // wlroots may also have picked pixman, e.g. with WLR_RENDERER=pixman or no GPU
+    server->software_renderer = wlr_renderer_is_pixman(server->renderer);
+
     server->allocator = wlr_allocator_autocreate(server->backend, server->renderer);
 
     // Create some default wlroots interfaces:
     // Compositor to handle surface allocation
 	server->compositor = wlr_compositor_create(server->wl_display, server->renderer);
+    // Presentation time, to tell clients exactly when their buffers were displayed
+    server->presentation = wlr_presentation_create(server->wl_display, server->backend);
+    // Viewporter, so that clients can have their buffers cropped and scaled while rendering
+    server->viewporter = wlr_viewporter_create(server->wl_display);
     // Data device manager to handle the clipboard
 	wlr_data_device_manager_create(server->wl_display);
 
+    // Screen capture, either by copying frames into client buffers or by exporting the
+    // output's own buffers as dmabufs to avoid the copy. Screencopy's copy_with_damage gets
+    // each frame's damage from wlr_output_set_damage in viv_render_output.
     wlr_screencopy_manager_v1_create(server->wl_display);
+    wlr_export_dmabuf_manager_v1_create(server->wl_display);
 
     wlr_primary_selection_v1_device_manager_create(server->wl_display);
 
     // Create an output layout, for handling the arrangement of multiple outputs
 	server->output_layout = wlr_output_layout_create();
 
+#ifdef SCENE_RENDERER
+    // Scene graph, which is drawn instead of using the custom renderer
+    viv_scene_init(server);
+#endif
+
     // Init server outputs list and handling for new outputs
 	wl_list_init(&server->outputs);
+	wl_list_init(&server->mirror_outputs);
 	server->new_output.notify = server_new_output;
 	wl_signal_add(&server->backend->events.new_output, &server->new_output);
 
@@ -755,11 +816,7 @@ void viv_server_init(struct viv_server *server) {
 
     wlr_log(WLR_INFO, "New viv_server initialised");
 
-    viv_parse_and_run_background_config(
-        server->config->background.colour,
-        server->config->background.image,
-        server->config->background.mode
-    );
+    viv_background_init(server);
 
     server->bar_pid = viv_parse_and_run_bar_config(server->config->bar.command, server->config->bar.update_signal_number);
 
@@ -828,6 +885,8 @@ void viv_server_deinit(struct viv_server *server) {
     wlr_xwayland_destroy(server->xwayland_shell);
 #endif
 
+    viv_background_fini(server);
+
 	wl_display_destroy_clients(server->wl_display);
 	wl_display_destroy(server->wl_display);
 }
@@ -11,6 +11,7 @@
 #include "viv_config_support.h"
 #include "viv_config_types.h"
 #include "viv_mappable_functions.h"
+#include "viv_output_mode.h"
 #include "viv_toml_config.h"
 #include "viv_types.h"
 
@@ -116,6 +117,20 @@ static struct string_map_pair damage_tracking_mode_map[] = {
     {"none", VIV_DAMAGE_TRACKING_NONE},
     {"frame", VIV_DAMAGE_TRACKING_FRAME},
     {"full", VIV_DAMAGE_TRACKING_FULL},
+    {"auto", VIV_DAMAGE_TRACKING_AUTO},
+    NULL_STRING_MAP_PAIR,
+};
+
+static struct string_map_pair renderer_type_map[] = {
+    {"auto", VIV_RENDERER_AUTO},
+    {"pixman", VIV_RENDERER_PIXMAN},
+    NULL_STRING_MAP_PAIR,
+};
+
+static struct string_map_pair adaptive_sync_mode_map[] = {
+    {"off", VIV_ADAPTIVE_SYNC_OFF},
+    {"on", VIV_ADAPTIVE_SYNC_ON},
+    {"fullscreen-only", VIV_ADAPTIVE_SYNC_FULLSCREEN_ONLY},
     NULL_STRING_MAP_PAIR,
 };
 
@@ -578,6 +593,82 @@ static void parse_libinput_config_table(toml_table_t *libinput_table, struct viv
     libinput_config->device_name = device_name.u.s;
 }
 
+static void parse_output_config_table(toml_table_t *output_table, struct viv_output_config *output_config) {
+    toml_datum_t name = toml_string_in(output_table, "name");
+    if (!name.ok) {
+        EXIT_WITH_MESSAGE("Error parsing [[output-config]]: no \"name\" provided");
+    }
+
+    output_config->render_scale = 1;
+    toml_datum_t render_scale = toml_double_in(output_table, "render-scale");
+    if (render_scale.ok) {
+        if ((render_scale.u.d <= 0) || (render_scale.u.d > 1)) {
+            EXIT_WITH_FORMATTED_MESSAGE("Error parsing [[output-config]] for output \"%s\": render-scale must be above 0 and at most 1, got %f",
+                                        name.u.s, render_scale.u.d);
+        }
+        output_config->render_scale = render_scale.u.d;
+    }
+
+    output_config->mirror = "";
+    toml_datum_t mirror = toml_string_in(output_table, "mirror");
+    if (mirror.ok) {
+        if (strcmp(mirror.u.s, name.u.s) == 0) {
+            EXIT_WITH_FORMATTED_MESSAGE("Error parsing [[output-config]] for output \"%s\": an output cannot mirror itself",
+                                        name.u.s);
+        }
+        output_config->mirror = mirror.u.s;
+    }
+
+    output_config->mode = "preferred";
+    toml_datum_t mode = toml_string_in(output_table, "mode");
+    if (mode.ok) {
+        struct viv_output_mode_spec spec;
+        if (!viv_output_mode_parse(mode.u.s, &spec)) {
+            EXIT_WITH_FORMATTED_MESSAGE("Error parsing [[output-config]] for output \"%s\": mode must be \"preferred\", \"highest-refresh\" or e.g. \"1920x1080@60\", got \"%s\"",
+                                        name.u.s, mode.u.s);
+        }
+        output_config->mode = mode.u.s;
+    }
+
+    output_config->idle_refresh_rate = 0;
+    toml_datum_t idle_refresh_rate = toml_double_in(output_table, "idle-refresh-rate");
+    if (idle_refresh_rate.ok) {
+        if (idle_refresh_rate.u.d < 0) {
+            EXIT_WITH_FORMATTED_MESSAGE("Error parsing [[output-config]] for output \"%s\": idle-refresh-rate must not be negative, got %f",
+                                        name.u.s, idle_refresh_rate.u.d);
+        }
+        output_config->idle_refresh_rate = idle_refresh_rate.u.d;
+    }
+
+    output_config->idle_refresh_timeout = 10;
+    toml_datum_t idle_refresh_timeout = toml_double_in(output_table, "idle-refresh-timeout");
+    if (idle_refresh_timeout.ok) {
+        if (idle_refresh_timeout.u.d <= 0) {
+            EXIT_WITH_FORMATTED_MESSAGE("Error parsing [[output-config]] for output \"%s\": idle-refresh-timeout must be above 0, got %f",
+                                        name.u.s, idle_refresh_timeout.u.d);
+        }
+        output_config->idle_refresh_timeout = idle_refresh_timeout.u.d;
+    }
+
+    output_config->adaptive_sync = VIV_ADAPTIVE_SYNC_OFF;
+    toml_datum_t adaptive_sync = toml_string_in(output_table, "adaptive-sync");
+    if (adaptive_sync.ok) {
+        uint32_t adaptive_sync_mode;
+        if (!look_up_string_in_map(adaptive_sync.u.s, adaptive_sync_mode_map, &adaptive_sync_mode)) {
+            EXIT_WITH_FORMATTED_MESSAGE("Error parsing [[output-config]] for output \"%s\": adaptive-sync must be \"off\", \"on\" or \"fullscreen-only\", got \"%s\"",
+                                        name.u.s, adaptive_sync.u.s);
+        }
+        output_config->adaptive_sync = adaptive_sync_mode;
+        free(adaptive_sync.u.s);
+    }
+
+    wlr_log(WLR_DEBUG, "Parsed [[output-config]] for output \"%s\", render scale %f, mirror \"%s\", mode \"%s\", idle refresh rate %f, idle refresh timeout %f, adaptive sync %d",
+            name.u.s, output_config->render_scale, output_config->mirror, output_config->mode,
+            output_config->idle_refresh_rate, output_config->idle_refresh_timeout, output_config->adaptive_sync);
+
+    output_config->name = name.u.s;
+}
+
 /// Allocate and return a new keybinds list with autogenerated bindings for switching
 /// workspace and moving windows to each workspace. The autogenerated bindings use the
 /// number row.
@@ -648,8 +739,6 @@ static struct viv_keybind *append_workspace_keybinds(char workspaces[MAX_NUM_WOR
 }
 
 void load_file_as_toml_config(FILE *fp, struct viv_config *config) {
-    UNUSED(parse_config_double);
-
     char errbuf[ERRBUF_SIZE];
     toml_table_t *root = toml_parse_file(fp, errbuf, sizeof(errbuf));
 
@@ -709,11 +798,23 @@ void load_file_as_toml_config(FILE *fp, struct viv_config *config) {
     parse_config_string_raw(root, "bar", "command", &config->bar.command, true);
     parse_config_uint(root, "bar", "update-signal-number", &config->bar.update_signal_number);
 
+    // [render]
+    parse_config_uint(root, "render", "damage-max-rects", &config->render.damage_max_rects);
+    parse_config_double(root, "render", "damage-max-waste", &config->render.damage_max_waste);
+    parse_config_int(root, "render", "max-render-time", &config->render.max_render_time);
+    parse_config_double(root, "render", "auto-whole-frame-area", &config->render.auto_whole_frame_area);
+    parse_config_uint(root, "render", "auto-whole-frame-rects", &config->render.auto_whole_frame_rects);
+    parse_config_bool(root, "render", "view-texture-cache", &config->render.view_texture_cache);
+    parse_config_string_map(root, "render", "renderer", renderer_type_map, &config->render.renderer);
+    parse_config_double(root, "render", "hidden-view-frame-rate", &config->render.hidden_view_frame_rate);
+    parse_config_double(root, "render", "powered-off-frame-rate", &config->render.powered_off_frame_rate);
+
     // [debug]
     parse_config_bool(root, "debug", "mark-views-by-shell", &config->debug_mark_views_by_shell);
     parse_config_bool(root, "debug", "mark-active-output", &config->debug_mark_active_output);
     parse_config_bool(root, "debug", "mark-undamaged-regions", &config->debug_mark_undamaged_regions);
     parse_config_bool(root, "debug", "mark-frame-draws", &config->debug_mark_frame_draws);
+    parse_config_bool(root, "debug", "allow-direct-scanout", &config->debug_allow_direct_scanout);
     parse_config_string_map(root, "debug", "damage-tracking-mode", damage_tracking_mode_map,
                             &config->damage_tracking_mode);
 
@@ -734,6 +835,9 @@ void load_file_as_toml_config(FILE *fp, struct viv_config *config) {
     // [[libinput-config]] list
     PARSE_CONFIG_ARRAY_VARIABLE_LENGTH(root, "libinput-config", struct viv_libinput_config, parse_libinput_config_table, TERMINATE_LIBINPUT_CONFIG_LIST(), &config->libinput_configs);
 
+    // [[output-config]] list
+    PARSE_CONFIG_ARRAY_VARIABLE_LENGTH(root, "output-config", struct viv_output_config, parse_output_config_table, TERMINATE_OUTPUT_CONFIG_LIST(), &config->output_configs);
+
     toml_free(root);
 }
 
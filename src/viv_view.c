@@ -9,7 +9,9 @@
 
 #include "viv_view.h"
 
+#include "viv_damage.h"
 #include "viv_output.h"
+#include "viv_render.h"
 #include "viv_seat.h"
 #include "viv_server.h"
 #include "viv_types.h"
@@ -17,12 +19,23 @@
 #include "viv_workspace.h"
 #include "viv_wlr_surface_tree.h"
 
+#ifdef SCENE_RENDERER
+#include "viv_scene.h"
+#endif
+
 #define VIEW_NAME_LEN 100
 
 void viv_view_bring_to_front(struct viv_view *view) {
     struct wl_list *link = &view->workspace_link;
+    if (view->workspace->views.next == link) {
+        return;
+    }
     wl_list_remove(link);
     wl_list_insert(&view->workspace->views, link);
+
+    // Restacking changes the render order, and the view may now be drawn over others
+    viv_render_invalidate_entries(view->server);
+    viv_view_damage(view);
 }
 
 void viv_view_clear_all_focus(struct viv_server *server) {
@@ -30,21 +43,49 @@ void viv_view_clear_all_focus(struct viv_server *server) {
     viv_seat_clear_focus(seat);
 }
 
+/// True if the view's target box overlaps that of any other tiled view in its workspace
+static bool view_overlaps_tiled_views(struct viv_view *view) {
+    struct viv_view *other_view;
+    wl_list_for_each(other_view, &view->workspace->views, workspace_link) {
+        if ((other_view == view) || other_view->is_floating || !other_view->mapped) {
+            continue;
+        }
+        struct wlr_box intersection;
+        if (wlr_box_intersection(&intersection, &view->target_box, &other_view->target_box)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Damage whatever looks different when the view gains or loses focus. Normally this is
+/// only its border, but the active tiled view is also drawn above other tiled views, so if
+/// it overlaps any of them then the whole view is damaged.
+static void damage_focus_change(struct viv_view *view) {
+    if (!view->is_floating && view_overlaps_tiled_views(view)) {
+        viv_view_damage(view);
+    } else {
+        viv_view_damage_borders(view);
+    }
+}
+
 void viv_view_focus(struct viv_view *view) {
 	if (view == NULL) {
 		return;
 	}
 	struct viv_server *server = view->server;
 
-    // Damage both previous and newly-active surface
-    // TODO: only damage the borders
-    if (view->workspace->active_view) {
-        viv_view_damage(view->workspace->active_view);
-    }
-    viv_view_damage(view);
-
 	/* Activate the new surface */
+    struct viv_view *prev_active_view = view->workspace->active_view;
     view->workspace->active_view = view;
+    viv_render_invalidate_entries(server);
+
+    // Damage both previous and newly-active view
+    if (prev_active_view && (prev_active_view != view)) {
+        damage_focus_change(prev_active_view);
+    }
+    damage_focus_change(view);
+
     if (server->active_output->current_workspace == view->workspace) {
         // Prevent focus from leaving current workspace
         viv_seat_focus_view(viv_server_get_default_seat(server), view);
@@ -175,11 +216,69 @@ bool viv_view_oversized(struct viv_view *view) {
     return view->implementation->oversized(view);
 }
 
+bool viv_view_is_visible_on_output(struct viv_view *view, struct viv_output *output) {
+    struct viv_workspace *workspace = view->workspace;
+    if (workspace->output == NULL) {
+        // The view's workspace isn't displayed anywhere
+        return false;
+    }
+
+    if ((workspace->output != output) && !view->is_floating) {
+        // Only floating views are drawn overhanging other outputs
+        return false;
+    }
+
+    struct viv_view *fullscreen_view = output->current_workspace->fullscreen_view;
+    if (fullscreen_view && (fullscreen_view != view)) {
+        // Nothing but the fullscreen view is drawn
+        return false;
+    }
+
+    return true;
+}
+
+struct viv_output *viv_view_get_primary_output(struct viv_view *view) {
+    struct viv_output *primary_output = view->workspace->output;
+    if ((primary_output == NULL) || !view->is_floating) {
+        // Only floating views are drawn on outputs other than their workspace's
+        return primary_output;
+    }
+
+    struct wlr_box geo_box;
+    viv_view_get_geometry(view, &geo_box);
+
+    int64_t max_area = 0;
+    struct viv_output *output;
+    wl_list_for_each(output, &view->server->outputs, link) {
+        if (!output->wlr_output->enabled || !viv_view_is_visible_on_output(view, output)) {
+            continue;
+        }
+        struct wlr_box *output_box = wlr_output_layout_get_box(view->server->output_layout, output->wlr_output);
+        struct wlr_box intersection;
+        if (!output_box || !wlr_box_intersection(&intersection, output_box, &geo_box)) {
+            continue;
+        }
+        int64_t area = (int64_t)intersection.width * intersection.height;
+        if (area > max_area) {
+            max_area = area;
+            primary_output = output;
+        }
+    }
+    return primary_output;
+}
+
 void viv_view_damage(struct viv_view *view) {
     struct viv_output *output;
     struct wlr_box geo_box = { 0 };
 
+    if (view->workspace->output == NULL) {
+        // Views on hidden workspaces can't be seen, so damaging them would only cause
+        // pointless redraws
+        return;
+    }
+
     if (view->workspace->fullscreen_view == view) {
+        // Damage every output, in case the view was just floating over others
         wl_list_for_each(output, &view->server->outputs, link) {
             viv_output_damage(output);
         }
@@ -195,10 +294,78 @@ void viv_view_damage(struct viv_view *view) {
     geo_box.height += 2 * border_width;
 
     wl_list_for_each(output, &view->server->outputs, link) {
+        if (!viv_view_is_visible_on_output(view, output)) {
+            continue;
+        }
         viv_output_damage_layout_coords_box(output, &geo_box);
     }
 }
 
+bool viv_view_draws_borders(struct viv_view *view) {
+    if (view->is_static || (view->workspace->fullscreen_view == view)) {
+        return false;
+    }
+    return view->is_floating || !view->workspace->active_layout->no_borders;
+}
+
+bool viv_view_is_active_on_output(struct viv_view *view, struct viv_output *output) {
+    struct viv_seat *seat = viv_server_get_default_seat(view->server);
+    bool is_grabbed = ((seat->cursor_mode != VIV_CURSOR_PASSTHROUGH) &&
+                       viv_server_any_seat_grabs(view->server, view));
+    bool is_active_on_current_output = ((output == output->server->active_output) &
+                                        (view == view->workspace->active_view));
+    return is_grabbed || is_active_on_current_output;
+}
+
+pixman_region32_t *viv_view_get_border_region(struct viv_view *view) {
+    struct wlr_box *target_box = &view->target_box;
+    struct wlr_box *cached_box = &view->border_region_box;
+    if (view->border_region_valid &&
+        (target_box->x == cached_box->x) && (target_box->y == cached_box->y) &&
+        (target_box->width == cached_box->width) && (target_box->height == cached_box->height)) {
+        return &view->border_region;
+    }
+
+    struct viv_config *config = view->server->config;
+    int gap_width = config->gap_width;
+    int line_width = config->border_width;
+
+    int x = target_box->x + gap_width;
+    int y = target_box->y + gap_width;
+    // Keep at least a pixel inside the gaps, so that the ring is never inside out
+    int width = target_box->width - 2 * gap_width;
+    int height = target_box->height - 2 * gap_width;
+    if (width < 1) {
+        width = 1;
+    }
+    if (height < 1) {
+        height = 1;
+    }
+
+    // The border is the ring between the outer box and the inner box it surrounds
+    pixman_region32_fini(&view->border_region);
+    pixman_region32_init_rect(&view->border_region, x, y, width, height);
+    if ((width > 2 * line_width) && (height > 2 * line_width)) {
+        pixman_region32_t inner;
+        pixman_region32_init_rect(&inner, x + line_width, y + line_width,
+                                  width - 2 * line_width, height - 2 * line_width);
+        pixman_region32_subtract(&view->border_region, &view->border_region, &inner);
+        pixman_region32_fini(&inner);
+    }
+
+    *cached_box = *target_box;
+    view->border_region_valid = true;
+
+    return &view->border_region;
+}
+
+void viv_view_damage_borders(struct viv_view *view) {
+    if (!view->mapped || !viv_view_draws_borders(view)) {
+        return;
+    }
+    viv_damage_layout_region(view->server, view, viv_view_get_border_region(view));
+}
+
 void viv_view_set_size(struct viv_view *view, uint32_t width, uint32_t height) {
     ASSERT(view->implementation->set_size != NULL);
     view->implementation->set_size(view, width, height);
@@ -223,6 +390,9 @@ void viv_view_init(struct viv_view *view, struct viv_server *server) {
 	view->server = server;
 	view->mapped = false;
 
+    pixman_region32_init(&view->border_region);
+    view->border_region_valid = false;
+
     // Make sure the view gets added to a workspace
     struct viv_output *output = server->active_output;
 
@@ -247,6 +417,7 @@ void viv_view_destroy(struct viv_view *view) {
     }
 
 	wl_list_remove(&view->workspace_link);
+    viv_render_invalidate_entries(view->server);
     wlr_log(WLR_INFO, "Destroying view at %p", view);
 
     if (view->surface_tree) {
@@ -254,6 +425,12 @@ void viv_view_destroy(struct viv_view *view) {
         view->surface_tree = NULL;
     }
 
+    pixman_region32_fini(&view->border_region);
+    viv_render_view_texture_cache_fini(view);
+#ifdef SCENE_RENDERER
+    viv_scene_view_unmap(view);
+#endif
+
 	free(view);
 }
 
@@ -331,6 +508,7 @@ void viv_view_ensure_not_active_in_workspace(struct viv_view *view) {
         } else {
             workspace->active_view = NULL;
         }
+        viv_render_invalidate_entries(view->server);
     }
 }
 
@@ -4,6 +4,7 @@
 
 #include "viv_damage.h"
 #include "viv_output.h"
+#include "viv_render.h"
 #include "viv_types.h"
 #include "viv_wlr_surface_tree.h"
 
@@ -12,22 +13,77 @@ static struct viv_surface_tree_node *viv_surface_tree_subsurface_node_create(str
                                                                              struct viv_wlr_subsurface *subsurface, struct wlr_surface *surface);
 static void viv_subsurface_destroy(struct viv_wlr_subsurface *subsurface);
 
-/// Walks up the surface tree until reaching the root, adding all the surface offsets along the way
-static void add_surface_global_offset(struct viv_surface_tree_node *node, int *lx, int *ly) {
+/// Walks up the surface tree until reaching the root, adding all the surface offsets along
+/// the way (but not the root's global offset)
+static void add_surface_root_offset(struct viv_surface_tree_node *node, int *lx, int *ly) {
     *lx += node->wlr_surface->sx;
     *ly += node->wlr_surface->sy;
 
     if (node->apply_global_offset) {
         // This is the root node
         ASSERT(!node->subsurface);
-        node->apply_global_offset(node->global_offset_data, lx, ly);
     } else {
         ASSERT(node->subsurface);
 
         *lx += node->subsurface->wlr_subsurface->current.x;
         *ly += node->subsurface->wlr_subsurface->current.y;
 
-        add_surface_global_offset(node->parent, lx, ly);
+        add_surface_root_offset(node->parent, lx, ly);
+    }
+}
+
+/// Add the node's layout coordinates to lx and ly, using the cached offset from the root
+/// if it is still valid
+static void add_surface_global_offset(struct viv_surface_tree_node *node, int *lx, int *ly) {
+    struct viv_surface_tree_node *root = node->root;
+
+    if (node->cached_offset_generation != root->offset_generation) {
+        node->root_offset_x = 0;
+        node->root_offset_y = 0;
+        add_surface_root_offset(node, &node->root_offset_x, &node->root_offset_y);
+        node->cached_offset_generation = root->offset_generation;
+    }
+
+    *lx += node->root_offset_x;
+    *ly += node->root_offset_y;
+
+    root->apply_global_offset(root->global_offset_data, lx, ly);
+}
+
+/// Check whether this commit moved the node's surface or any of its direct subsurfaces,
+/// and if so invalidate the cached offsets of the whole tree
+static void check_for_moved_surfaces(struct viv_surface_tree_node *node) {
+    bool moved = false;
+
+    struct wlr_surface *surface = node->wlr_surface;
+    if ((surface->sx != node->last_sx) || (surface->sy != node->last_sy)) {
+        node->last_sx = surface->sx;
+        node->last_sy = surface->sy;
+        moved = true;
+    }
+
+    // Subsurface positions are applied when their parent commits
+    struct viv_wlr_subsurface *subsurface;
+    wl_list_for_each(subsurface, &node->child_subsurfaces, node_link) {
+        struct wlr_subsurface *wlr_subsurface = subsurface->wlr_subsurface;
+        if ((wlr_subsurface->current.x != subsurface->last_x) || (wlr_subsurface->current.y != subsurface->last_y)) {
+            subsurface->last_x = wlr_subsurface->current.x;
+            subsurface->last_y = wlr_subsurface->current.y;
+            moved = true;
+        }
+    }
+
+    if (moved) {
+        node->root->offset_generation++;
+    }
+}
+
+/// Let the view owning the node's tree know if its main surfaces have changed. Popups have
+/// their own trees, which don't affect the view's texture cache.
+static void invalidate_view_texture_cache(struct viv_surface_tree_node *node) {
+    struct viv_view *view = node->view;
+    if (view && (view->surface_tree == node->root)) {
+        viv_render_view_texture_cache_invalidate(view);
     }
 }
 
@@ -38,6 +94,7 @@ static void handle_subsurface_map (struct wl_listener *listener, void *data) {
 
 
     subsurface->child = viv_surface_tree_subsurface_node_create(subsurface->server, subsurface->parent, subsurface, wlr_subsurface->surface);
+    invalidate_view_texture_cache(subsurface->parent);
 
     wlr_log(WLR_INFO, "Mapped subsurface at %p creates node at %p", subsurface, subsurface->child);
 }
@@ -50,6 +107,7 @@ static void handle_subsurface_unmap (struct wl_listener *listener, void *data) {
     if (subsurface->child) {
 
         struct viv_surface_tree_node *node = subsurface->child;
+        invalidate_view_texture_cache(node);
 
         int lx = 0;
         int ly = 0;
@@ -57,13 +115,12 @@ static void handle_subsurface_unmap (struct wl_listener *listener, void *data) {
 
         struct wlr_box surface_extents = { 0 };
         wlr_surface_get_extends(node->wlr_surface, &surface_extents);
-        surface_extents.x += lx;
-        surface_extents.y += ly;
 
-        struct viv_output *output;
-        wl_list_for_each(output, &node->server->outputs, link) {
-            viv_output_damage_layout_coords_box(output, &surface_extents);
-        }
+        pixman_region32_t damage;
+        pixman_region32_init_rect(&damage, surface_extents.x + lx, surface_extents.y + ly,
+                                  surface_extents.width, surface_extents.height);
+        viv_damage_layout_region(node->server, node->view, &damage);
+        pixman_region32_fini(&damage);
 
         viv_surface_tree_destroy(subsurface->child);
         subsurface->child = NULL;
@@ -93,6 +150,8 @@ static void handle_new_node_subsurface (struct wl_listener *listener, void *data
     subsurface->server = node->server;
     subsurface->wlr_subsurface = wlr_subsurface;
     subsurface->parent = node;
+    subsurface->last_x = wlr_subsurface->current.x;
+    subsurface->last_y = wlr_subsurface->current.y;
 
     subsurface->map.notify = handle_subsurface_map;
     wl_signal_add(&wlr_subsurface->events.map, &subsurface->map);
@@ -119,10 +178,13 @@ static void handle_commit(struct wl_listener *listener, void *data) {
     struct viv_surface_tree_node *node = wl_container_of(listener, node, commit);
     struct wlr_surface *surface = node->wlr_surface;
 
+    check_for_moved_surfaces(node);
+    invalidate_view_texture_cache(node);
+
     int lx = 0;
     int ly = 0;
     add_surface_global_offset(node, &lx, &ly);
-    viv_damage_surface(node->server, surface, lx, ly);
+    viv_damage_surface(node->server, node->view, surface, lx, ly);
 }
 
 static void handle_node_destroy(struct wl_listener *listener, void *data) {
@@ -152,6 +214,8 @@ static struct viv_surface_tree_node *viv_surface_tree_create(struct viv_server *
 
     node->server = server;
     node->wlr_surface = surface;
+    node->last_sx = surface->sx;
+    node->last_sy = surface->sy;
 
     wl_list_init(&node->child_subsurfaces);
 
@@ -182,13 +246,15 @@ static struct viv_surface_tree_node *viv_surface_tree_subsurface_node_create(str
     ASSERT(surface);
 
     struct viv_surface_tree_node *node = viv_surface_tree_create(server, surface);
+    node->root = parent->root;
     node->parent = parent;
     node->subsurface = subsurface;
+    node->view = parent->view;
 
     return node;
 }
 
-struct viv_surface_tree_node *viv_surface_tree_root_create(struct viv_server *server, struct wlr_surface *surface, void (*apply_global_offset)(void *, int *, int *), void *global_offset_data) {
+struct viv_surface_tree_node *viv_surface_tree_root_create(struct viv_server *server, struct wlr_surface *surface, void (*apply_global_offset)(void *, int *, int *), void *global_offset_data, struct viv_view *view) {
     ASSERT(server);
     ASSERT(surface);
     ASSERT(apply_global_offset);
@@ -196,6 +262,11 @@ struct viv_surface_tree_node *viv_surface_tree_root_create(struct viv_server *se
     struct viv_surface_tree_node *node = viv_surface_tree_create(server, surface);
     node->apply_global_offset = apply_global_offset;
     node->global_offset_data = global_offset_data;
+    node->view = view;
+
+    // Start with the root's own offset cache invalid
+    node->root = node;
+    node->offset_generation = 1;
 
     return node;
 }
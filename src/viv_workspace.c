@@ -4,6 +4,7 @@
 #include "viv_cursor.h"
 #include "viv_layout.h"
 #include "viv_output.h"
+#include "viv_render.h"
 #include "viv_server.h"
 #include "viv_types.h"
 #include "viv_view.h"
@@ -12,6 +13,7 @@
 
 void viv_workspace_mark_for_relayout(struct viv_workspace *workspace) {
     workspace->needs_layout = true;
+    viv_render_invalidate_entries(workspace->server);
     viv_workspace_damage_views(workspace);  // TODO: is this 100% redundant with damaging the output?
     if (workspace->output) {
         viv_output_damage(workspace->output);
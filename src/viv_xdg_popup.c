@@ -6,31 +6,56 @@
 #include "viv_xdg_popup.h"
 #include "viv_wlr_surface_tree.h"
 
-/// Add to x and y the global (i.e. output-layout) coords of the input popup, calculated
-/// by walking up the popup tree and adding the geometry of each parent.
+#ifdef SCENE_RENDERER
+#include "viv_scene.h"
+#endif
+
+/// Add to x and y the global (i.e. output-layout) coords of the input popup. The offset
+/// from the parent view is calculated by walking up the popup tree and adding the
+/// geometry of each parent, then cached until any popup geometry changes.
 static void add_popup_global_coords(void *popup_pointer, int *x, int *y) {
     struct viv_xdg_popup *popup = popup_pointer;
 
-    int px = 0;
-    int py = 0;
+    if (popup->cached_offset_generation != popup->server->popup_geometry_generation) {
+        int px = 0;
+        int py = 0;
 
-    struct viv_xdg_popup *cur_popup = popup;
-    while (true) {
-        px += cur_popup->wlr_popup->geometry.x;
-        py += cur_popup->wlr_popup->geometry.y;
+        struct viv_xdg_popup *cur_popup = popup;
+        while (true) {
+            px += cur_popup->wlr_popup->geometry.x;
+            py += cur_popup->wlr_popup->geometry.y;
 
-        if (cur_popup->parent_popup != NULL) {
-            cur_popup = cur_popup->parent_popup;
-        } else {
-            break;
+            if (cur_popup->parent_popup != NULL) {
+                cur_popup = cur_popup->parent_popup;
+            } else {
+                break;
+            }
         }
+
+        popup->offset_x = px;
+        popup->offset_y = py;
+        popup->cached_offset_generation = popup->server->popup_geometry_generation;
     }
 
-    px += *popup->lx;
-    py += *popup->ly;
+    *x += popup->offset_x + *popup->lx;
+    *y += popup->offset_y + *popup->ly;
+}
 
-    *x += px;
-    *y += py;
+/// Invalidate all cached popup offsets if this popup's geometry has changed
+static void check_popup_geometry(struct viv_xdg_popup *popup) {
+    struct wlr_box *geometry = &popup->wlr_popup->geometry;
+    struct wlr_box *last = &popup->last_geometry;
+    if ((geometry->x != last->x) || (geometry->y != last->y) ||
+        (geometry->width != last->width) || (geometry->height != last->height)) {
+        *last = *geometry;
+        popup->server->popup_geometry_generation++;
+    }
+}
+
+static void handle_popup_surface_commit(struct wl_listener *listener, void *data) {
+    UNUSED(data);
+    struct viv_xdg_popup *popup = wl_container_of(listener, popup, surface_commit);
+    check_popup_geometry(popup);
 }
 
 static void handle_popup_surface_map(struct wl_listener *listener, void *data) {
@@ -38,7 +63,11 @@ static void handle_popup_surface_map(struct wl_listener *listener, void *data) {
     struct viv_xdg_popup *popup = wl_container_of(listener, popup, surface_map);
     wlr_log(WLR_INFO, "Map popup at %p", popup);
 
-    popup->surface_tree = viv_surface_tree_root_create(popup->server, popup->wlr_popup->base->surface, &add_popup_global_coords, popup);
+    popup->surface_tree = viv_surface_tree_root_create(popup->server, popup->wlr_popup->base->surface, &add_popup_global_coords, popup, popup->view);
+
+#ifdef SCENE_RENDERER
+    viv_scene_popup_map(popup);
+#endif
 }
 
 static void handle_popup_surface_unmap(struct wl_listener *listener, void *data) {
@@ -54,17 +83,10 @@ static void handle_popup_surface_unmap(struct wl_listener *listener, void *data)
     int py = 0;
     add_popup_global_coords(popup, &px, &py);
 
-    struct wlr_box geo_box = {
-        .x = px,
-        .y = py,
-        .width = popup->wlr_popup->geometry.width,
-        .height = popup->wlr_popup->geometry.height,
-    };
-
-    struct viv_output *output;
-    wl_list_for_each(output, &popup->server->outputs, link) {
-        viv_output_damage_layout_coords_box(output, &geo_box);
-    }
+    pixman_region32_t damage;
+    pixman_region32_init_rect(&damage, px, py, popup->wlr_popup->geometry.width, popup->wlr_popup->geometry.height);
+    viv_damage_layout_region(popup->server, popup->view, &damage);
+    pixman_region32_fini(&damage);
 }
 
 static void handle_popup_surface_destroy(struct wl_listener *listener, void *data) {
@@ -75,6 +97,16 @@ static void handle_popup_surface_destroy(struct wl_listener *listener, void *dat
         viv_surface_tree_destroy(popup->surface_tree);
         popup->surface_tree = NULL;
     }
+#ifdef SCENE_RENDERER
+    viv_scene_popup_destroy(popup);
+#endif
+
+    wl_list_remove(&popup->surface_commit.link);
+    wl_list_remove(&popup->surface_map.link);
+    wl_list_remove(&popup->surface_unmap.link);
+    wl_list_remove(&popup->destroy.link);
+    wl_list_remove(&popup->new_popup.link);
+
     free(popup);
 }
 
@@ -84,8 +116,12 @@ static void handle_new_popup(struct wl_listener *listener, void *data) {
 
     struct viv_xdg_popup *new_popup = calloc(1, sizeof(struct viv_xdg_popup));
     new_popup->server = popup->server;
+    new_popup->view = popup->view;
     new_popup->lx = popup->lx;
     new_popup->ly = popup->ly;
+#ifdef SCENE_RENDERER
+    new_popup->parent_scene_node = &popup->scene_node;
+#endif
     new_popup->parent_popup = popup;
     viv_xdg_popup_init(new_popup, wlr_popup);
 }
@@ -117,10 +153,13 @@ static void popup_unconstrain(struct viv_xdg_popup *popup) {
     };
 
     wlr_xdg_popup_unconstrain_from_box(wlr_popup, &output_box);
+
+    check_popup_geometry(popup);
 }
 
 void viv_xdg_popup_init(struct viv_xdg_popup *popup, struct wlr_xdg_popup *wlr_popup) {
     popup->wlr_popup = wlr_popup;
+    popup->cached_offset_generation = popup->server->popup_geometry_generation - 1;
 
     wlr_log(WLR_INFO, "New popup %p with parent %p", popup, popup->parent_popup);
 
@@ -130,6 +169,11 @@ void viv_xdg_popup_init(struct viv_xdg_popup *popup, struct wlr_xdg_popup *wlr_p
     popup->surface_unmap.notify = handle_popup_surface_unmap;
     wl_signal_add(&wlr_popup->base->events.unmap, &popup->surface_unmap);
 
+    // Added before the surface tree's commit listener, so that popup offsets are
+    // invalidated before the commit is damaged
+    popup->surface_commit.notify = handle_popup_surface_commit;
+    wl_signal_add(&wlr_popup->base->surface->events.commit, &popup->surface_commit);
+
     popup->destroy.notify = handle_popup_surface_destroy;
     wl_signal_add(&wlr_popup->base->surface->events.destroy, &popup->destroy);
 
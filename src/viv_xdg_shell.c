@@ -15,6 +15,10 @@
 #include "viv_xdg_popup.h"
 #include "viv_output.h"
 
+#ifdef SCENE_RENDERER
+#include "viv_scene.h"
+#endif
+
 /// Return true if the view looks like it should be floating.
 static bool guess_should_be_floating(struct viv_view *view) {
     if (view->xdg_surface->toplevel->parent) {
@@ -129,7 +133,11 @@ static void xdg_surface_map(struct wl_listener *listener, void *data) {
 
     viv_workspace_add_view(view->workspace, view);
 
-    view->surface_tree = viv_surface_tree_root_create(view->server, view->xdg_surface->surface, &add_xdg_view_global_coords, view);
+    view->surface_tree = viv_surface_tree_root_create(view->server, view->xdg_surface->surface, &add_xdg_view_global_coords, view, view);
+
+#ifdef SCENE_RENDERER
+    viv_scene_view_map(view);
+#endif
 }
 
 static void xdg_surface_unmap(struct wl_listener *listener, void *data) {
@@ -150,6 +158,10 @@ static void xdg_surface_unmap(struct wl_listener *listener, void *data) {
 
     viv_surface_tree_destroy(view->surface_tree);
     view->surface_tree = NULL;
+
+#ifdef SCENE_RENDERER
+    viv_scene_view_unmap(view);
+#endif
 }
 
 static void xdg_surface_destroy(struct wl_listener *listener, void *data) {
@@ -400,8 +412,12 @@ static void handle_xdg_surface_new_popup(struct wl_listener *listener, void *dat
 
     struct viv_xdg_popup *popup = calloc(1, sizeof(struct viv_xdg_popup));
     popup->server = view->server;
+    popup->view = view;
     popup->lx = &view->x;
     popup->ly = &view->y;
+#ifdef SCENE_RENDERER
+    popup->parent_scene_node = &view->scene.surface;
+#endif
     viv_xdg_popup_init(popup, wlr_popup);
 }
 
@@ -11,6 +11,10 @@
 #include "viv_xwayland_shell.h"
 #include "viv_xwayland_types.h"
 
+#ifdef SCENE_RENDERER
+#include "viv_scene.h"
+#endif
+
 
 #define AS_STR(ATOM) #ATOM,
 
@@ -217,7 +221,11 @@ static void event_xwayland_surface_map(struct wl_listener *listener, void *data)
         wlr_xwayland_surface_set_fullscreen(surface, view->workspace->fullscreen_view == view);
     }
 
-    view->surface_tree = viv_surface_tree_root_create(view->server, view->xwayland_surface->surface, &add_xwayland_view_global_coords, view);
+    view->surface_tree = viv_surface_tree_root_create(view->server, view->xwayland_surface->surface, &add_xwayland_view_global_coords, view, view);
+
+#ifdef SCENE_RENDERER
+    viv_scene_view_map(view);
+#endif
 }
 
 static void event_xwayland_surface_unmap(struct wl_listener *listener, void *data) {
@@ -239,6 +247,10 @@ static void event_xwayland_surface_unmap(struct wl_listener *listener, void *dat
     viv_surface_tree_destroy(view->surface_tree);
     view->surface_tree = NULL;
 
+#ifdef SCENE_RENDERER
+    viv_scene_view_unmap(view);
+#endif
+
     viv_server_clear_view_from_grab_state(view->server, view);
 }
 
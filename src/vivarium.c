@@ -5,9 +5,13 @@
 #include <unistd.h>
 #include <wayland-server-core.h>
 #include <wlr/backend.h>
-#ifdef HEADLESS_TEST
+#if defined(HEADLESS_TEST) || defined(HEADLESS_BENCHMARK)
 #include <wlr/backend/headless.h>
 #endif
+#ifdef HEADLESS_BENCHMARK
+#include <signal.h>
+#include <sys/wait.h>
+#endif
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_compositor.h>
@@ -39,6 +43,117 @@ static void headless_test(struct viv_server *server) {
 }
 #endif
 
+#ifdef HEADLESS_BENCHMARK
+#define BENCHMARK_MAX_CLIENTS 64
+
+/// State for running the same client workload on a headless output with either renderer
+struct viv_benchmark {
+    struct viv_server *server;
+    pid_t clients[BENCHMARK_MAX_CLIENTS];
+    int num_clients;
+};
+
+/// Get an integer from the environment, or the default if the variable is unset or invalid
+static int get_benchmark_env_int(const char *name, int default_value, int max_value) {
+    const char *value = getenv(name);
+    if (value == NULL) {
+        return default_value;
+    }
+    int parsed_value = atoi(value);
+    if ((parsed_value < 1) || (parsed_value > max_value)) {
+        wlr_log(WLR_ERROR, "Ignoring invalid %s=\"%s\", using %d", name, value, default_value);
+        return default_value;
+    }
+    return parsed_value;
+}
+
+/// Start VIV_BENCHMARK_CLIENTS copies of the VIV_BENCHMARK_CLIENT command, which should
+/// keep drawing until killed
+static void start_benchmark_clients(struct viv_benchmark *benchmark) {
+    const char *command = getenv("VIV_BENCHMARK_CLIENT");
+    if (command == NULL) {
+        command = "weston-simple-shm";
+    }
+    int num_clients = get_benchmark_env_int("VIV_BENCHMARK_CLIENTS", 4, BENCHMARK_MAX_CLIENTS);
+
+    for (int i = 0; i < num_clients; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            execl("/bin/sh", "/bin/sh", "-c", command, (void *)NULL);
+            _exit(1);
+        } else if (pid < 0) {
+            wlr_log(WLR_ERROR, "Failed to start benchmark client \"%s\"", command);
+            break;
+        }
+        benchmark->clients[benchmark->num_clients++] = pid;
+    }
+}
+
+static void stop_benchmark_clients(struct viv_benchmark *benchmark) {
+    for (int i = 0; i < benchmark->num_clients; i++) {
+        kill(benchmark->clients[i], SIGTERM);
+        waitpid(benchmark->clients[i], NULL, 0);
+    }
+    benchmark->num_clients = 0;
+}
+
+static int handle_benchmark_timeout(void *data) {
+    struct viv_benchmark *benchmark = data;
+    wl_display_terminate(benchmark->server->wl_display);
+    return 0;
+}
+
+/// Print the render timings of every output, in a format that is easy to compare between
+/// builds
+static void print_benchmark_results(struct viv_server *server) {
+#ifdef SCENE_RENDERER
+    const char *renderer = "scene";
+#else
+    const char *renderer = "custom";
+#endif
+
+    struct viv_output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        struct viv_render_stats *stats = &output->render_stats;
+        int64_t mean_render_usec = 0;
+        int64_t mean_render_cpu_usec = 0;
+        if (stats->frames_rendered > 0) {
+            mean_render_usec = stats->total_render_nsec / stats->frames_rendered / 1000;
+            mean_render_cpu_usec = stats->total_render_cpu_nsec / stats->frames_rendered / 1000;
+        }
+        printf("benchmark: renderer=%s backend=%s output=%s frames=%u mean_render_usec=%ld "
+               "max_render_usec=%ld mean_render_cpu_usec=%ld scanout_frames=%u scanout_switches=%u "
+               "hidden_views=%u refresh_mhz=%d\n",
+               renderer, server->software_renderer ? "pixman" : "gpu",
+               output->wlr_output->name, stats->frames_rendered,
+               (long)mean_render_usec, (long)(stats->max_render_nsec / 1000), (long)mean_render_cpu_usec,
+               stats->scanout_frames, stats->scanout_switches, stats->hidden_views,
+               output->wlr_output->refresh);
+    }
+}
+
+/// Draw the benchmark clients on a headless output for VIV_BENCHMARK_SECONDS, then print
+/// how long rendering took
+static void headless_benchmark(struct viv_server *server) {
+    struct viv_benchmark benchmark = { .server = server };
+
+    wlr_headless_add_output(server->backend, 1920, 1080);
+    start_benchmark_clients(&benchmark);
+
+    int seconds = get_benchmark_env_int("VIV_BENCHMARK_SECONDS", 10, 3600);
+    struct wl_event_loop *event_loop = wl_display_get_event_loop(server->wl_display);
+    struct wl_event_source *timer = wl_event_loop_add_timer(event_loop, handle_benchmark_timeout, &benchmark);
+    CHECK_ALLOCATION(timer);
+    wl_event_source_timer_update(timer, seconds * 1000);
+
+    wl_display_run(server->wl_display);
+
+    wl_event_source_remove(timer);
+    print_benchmark_results(server);
+    stop_benchmark_clients(&benchmark);
+}
+#endif
+
 int main(int argc, char *argv[]) {
     UNUSED(argc);
     UNUSED(argv);
@@ -51,6 +166,7 @@ int main(int argc, char *argv[]) {
     // outputs and window events can be handles.
 	struct viv_server server = { .config = NULL };
     server.user_provided_config_filen = parsed_args.config_filen;
+    server.user_requested_software_renderer = parsed_args.software_renderer;
     viv_server_init(&server);
 
 	// Add a Unix socket to the Wayland display.
@@ -78,15 +194,19 @@ int main(int argc, char *argv[]) {
     setenv("QT_QPA_PLATFORM", "wayland", true);
     setenv("MOZ_ENABLE_WAYLAND", "1", true);
 
-#ifndef HEADLESS_TEST
+#if defined(HEADLESS_TEST)
+    // Don't run the compositor, just set up some headless outputs for CI testing
+	wlr_log(WLR_INFO, "Running headless Wayland compositor on WAYLAND_DISPLAY=%s", socket);
+    headless_test(&server);
+#elif defined(HEADLESS_BENCHMARK)
+    // Run the compositor with a fixed workload for a fixed time
+	wlr_log(WLR_INFO, "Running headless benchmark on WAYLAND_DISPLAY=%s", socket);
+    headless_benchmark(&server);
+#else
     // Start the wayland eventloop. From here, all compositor activity comes via events it
     // sends us.
 	wlr_log(WLR_INFO, "Running Wayland compositor on WAYLAND_DISPLAY=%s", socket);
 	wl_display_run(server.wl_display);
-#else
-    // Don't run the compositor, just set up some headless outputs for CI testing
-	wlr_log(WLR_INFO, "Running headless Wayland compositor on WAYLAND_DISPLAY=%s", socket);
-    headless_test(&server);
 #endif
 
     viv_server_deinit(&server);
@@ -77,10 +77,21 @@ void test_config_toml_static_options_match_defaults(void) {
     TEST_ASSERT_CONFIG_EQUAL_STRING(bar.command);
     TEST_ASSERT_CONFIG_EQUAL(bar.update_signal_number);
 
+    TEST_ASSERT_CONFIG_EQUAL(render.damage_max_rects);
+    TEST_ASSERT_CONFIG_EQUAL_FLOAT(render.damage_max_waste);
+    TEST_ASSERT_CONFIG_EQUAL(render.max_render_time);
+    TEST_ASSERT_CONFIG_EQUAL_FLOAT(render.auto_whole_frame_area);
+    TEST_ASSERT_CONFIG_EQUAL(render.auto_whole_frame_rects);
+    TEST_ASSERT_CONFIG_EQUAL(render.view_texture_cache);
+    TEST_ASSERT_CONFIG_EQUAL(render.renderer);
+    TEST_ASSERT_CONFIG_EQUAL_FLOAT(render.hidden_view_frame_rate);
+    TEST_ASSERT_CONFIG_EQUAL_FLOAT(render.powered_off_frame_rate);
+
     TEST_ASSERT_CONFIG_EQUAL(debug_mark_views_by_shell);
     TEST_ASSERT_CONFIG_EQUAL(debug_mark_active_output);
     TEST_ASSERT_CONFIG_EQUAL(debug_mark_undamaged_regions);
     TEST_ASSERT_CONFIG_EQUAL(debug_mark_frame_draws);
+    TEST_ASSERT_CONFIG_EQUAL(debug_allow_direct_scanout);
 
     TEST_ASSERT_CONFIG_EQUAL(damage_tracking_mode);
 }
@@ -152,6 +163,29 @@ void test_config_toml_libinput_configs_match_defaults(void) {
     }
 }
 
+void test_config_toml_output_configs_match_defaults(void) {
+    struct viv_config load_config = { 0 };
+    viv_toml_config_load(default_config_path, &load_config, true);
+    struct viv_config default_config = the_config;
+
+    for (size_t i = 0; i < MAX_LEN_STATIC_LISTS; i++) {
+        struct viv_output_config default_output_config = default_config.output_configs[i];
+        struct viv_output_config load_output_config = load_config.output_configs[i];
+
+        TEST_ASSERT_EQUAL_STRING(default_output_config.name, load_output_config.name);
+        TEST_ASSERT_EQUAL_FLOAT(default_output_config.render_scale, load_output_config.render_scale);
+        TEST_ASSERT_EQUAL_STRING(default_output_config.mirror, load_output_config.mirror);
+        TEST_ASSERT_EQUAL_STRING(default_output_config.mode, load_output_config.mode);
+        TEST_ASSERT_EQUAL_FLOAT(default_output_config.idle_refresh_rate, load_output_config.idle_refresh_rate);
+        TEST_ASSERT_EQUAL_FLOAT(default_output_config.idle_refresh_timeout, load_output_config.idle_refresh_timeout);
+        TEST_ASSERT_EQUAL(default_output_config.adaptive_sync, load_output_config.adaptive_sync);
+
+        if (strlen(default_output_config.name) == 0) {
+            break;
+        }
+    }
+}
+
 void test_config_toml_layouts_match_defaults(void) {
     struct viv_config load_config = { 0 };
     viv_toml_config_load(default_config_path, &load_config, true);
@@ -188,6 +222,7 @@ int main(int argc, char *argv[]) {
     RUN_TEST(test_config_toml_workspaces_match_defaults);
     RUN_TEST(test_config_toml_keybinds_match_defaults);
     RUN_TEST(test_config_toml_libinput_configs_match_defaults);
+    RUN_TEST(test_config_toml_output_configs_match_defaults);
     RUN_TEST(test_config_toml_layouts_match_defaults);
     return UNITY_END();
 }
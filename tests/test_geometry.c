@@ -0,0 +1,224 @@
+#include <unity.h>
+
+#include "viv_config_support.h"
+#include "viv_geometry.h"
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+#define NUM_TEST_SCALES 3
+static const float test_scales[NUM_TEST_SCALES] = {1, 1.5, 2};
+
+static void assert_box_equal(int x, int y, int width, int height, struct wlr_box *box) {
+    TEST_ASSERT_EQUAL_INT(x, box->x);
+    TEST_ASSERT_EQUAL_INT(y, box->y);
+    TEST_ASSERT_EQUAL_INT(width, box->width);
+    TEST_ASSERT_EQUAL_INT(height, box->height);
+}
+
+static void assert_box_contains(struct wlr_box *outer, struct wlr_box *inner) {
+    TEST_ASSERT_LESS_OR_EQUAL_INT(inner->x, outer->x);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(inner->y, outer->y);
+    TEST_ASSERT_GREATER_OR_EQUAL_INT(inner->x + inner->width, outer->x + outer->width);
+    TEST_ASSERT_GREATER_OR_EQUAL_INT(inner->y + inner->height, outer->y + outer->height);
+}
+
+void test_box_at_scale_1_is_only_translated(void) {
+    struct wlr_box layout_box = {.x = 1930, .y = 20, .width = 101, .height = 33};
+    struct wlr_box output_box;
+
+    viv_geometry_layout_box_to_output_box(&output_box, &layout_box, -1920, 0, 1, VIV_GEOMETRY_ROUND_NEAREST);
+    assert_box_equal(10, 20, 101, 33, &output_box);
+
+    viv_geometry_layout_box_to_output_box(&output_box, &layout_box, -1920, 0, 1, VIV_GEOMETRY_ROUND_OUTWARD);
+    assert_box_equal(10, 20, 101, 33, &output_box);
+}
+
+void test_box_at_scale_1_5_rounds_edges(void) {
+    // Edges at 16.5, 168, 10.5 and 60 output pixels
+    struct wlr_box layout_box = {.x = 11, .y = 7, .width = 101, .height = 33};
+    struct wlr_box output_box;
+
+    viv_geometry_layout_box_to_output_box(&output_box, &layout_box, 0, 0, 1.5, VIV_GEOMETRY_ROUND_NEAREST);
+    assert_box_equal(17, 11, 151, 49, &output_box);
+
+    viv_geometry_layout_box_to_output_box(&output_box, &layout_box, 0, 0, 1.5, VIV_GEOMETRY_ROUND_OUTWARD);
+    assert_box_equal(16, 10, 152, 50, &output_box);
+}
+
+void test_box_at_scale_1_5_on_offset_output(void) {
+    // The output offset is applied before scaling, so the output's origin is a pixel boundary
+    struct wlr_box layout_box = {.x = 1931, .y = 1087, .width = 101, .height = 33};
+    struct wlr_box output_box;
+
+    viv_geometry_layout_box_to_output_box(&output_box, &layout_box, -1920, -1080, 1.5, VIV_GEOMETRY_ROUND_OUTWARD);
+    assert_box_equal(16, 10, 152, 50, &output_box);
+}
+
+void test_box_at_scale_2_is_exact(void) {
+    struct wlr_box layout_box = {.x = 110, .y = 57, .width = 101, .height = 33};
+    struct wlr_box output_box;
+
+    viv_geometry_layout_box_to_output_box(&output_box, &layout_box, -100, -50, 2, VIV_GEOMETRY_ROUND_NEAREST);
+    assert_box_equal(20, 14, 202, 66, &output_box);
+
+    viv_geometry_layout_box_to_output_box(&output_box, &layout_box, -100, -50, 2, VIV_GEOMETRY_ROUND_OUTWARD);
+    assert_box_equal(20, 14, 202, 66, &output_box);
+}
+
+void test_damage_box_covers_drawn_box(void) {
+    for (size_t i = 0; i < NUM_TEST_SCALES; i++) {
+        float scale = test_scales[i];
+        for (int x = 0; x < 7; x++) {
+            for (int width = 1; width < 7; width++) {
+                struct wlr_box layout_box = {.x = x, .y = x, .width = width, .height = width};
+                struct wlr_box drawn_box, damage_box;
+                viv_geometry_layout_box_to_output_box(&drawn_box, &layout_box, 0, 0, scale, VIV_GEOMETRY_ROUND_NEAREST);
+                viv_geometry_layout_box_to_output_box(&damage_box, &layout_box, 0, 0, scale, VIV_GEOMETRY_ROUND_OUTWARD);
+                assert_box_contains(&damage_box, &drawn_box);
+            }
+        }
+    }
+}
+
+void test_adjacent_boxes_stay_adjacent(void) {
+    for (size_t i = 0; i < NUM_TEST_SCALES; i++) {
+        float scale = test_scales[i];
+        for (int x = 1; x < 7; x++) {
+            struct wlr_box left = {.x = 0, .y = 0, .width = x, .height = 1};
+            struct wlr_box right = {.x = x, .y = 0, .width = 5, .height = 1};
+            struct wlr_box output_left, output_right;
+            viv_geometry_layout_box_to_output_box(&output_left, &left, 0, 0, scale, VIV_GEOMETRY_ROUND_NEAREST);
+            viv_geometry_layout_box_to_output_box(&output_right, &right, 0, 0, scale, VIV_GEOMETRY_ROUND_NEAREST);
+            TEST_ASSERT_EQUAL_INT(output_left.x + output_left.width, output_right.x);
+        }
+    }
+}
+
+void test_region_matches_boxes_at_each_scale(void) {
+    struct wlr_box layout_boxes[2] = {
+        {.x = 1931, .y = 7, .width = 101, .height = 33},
+        {.x = 2100, .y = 300, .width = 5, .height = 9},
+    };
+
+    struct viv_geometry_scratch scratch = { 0 };
+    for (size_t i = 0; i < NUM_TEST_SCALES; i++) {
+        float scale = test_scales[i];
+
+        pixman_region32_t layout_region, output_region, expected_region;
+        pixman_region32_init(&layout_region);
+        pixman_region32_init(&output_region);
+        pixman_region32_init(&expected_region);
+
+        for (size_t j = 0; j < 2; j++) {
+            struct wlr_box *box = &layout_boxes[j];
+            pixman_region32_union_rect(&layout_region, &layout_region, box->x, box->y, box->width, box->height);
+
+            struct wlr_box output_box;
+            viv_geometry_layout_box_to_output_box(&output_box, box, -1920, 0, scale, VIV_GEOMETRY_ROUND_OUTWARD);
+            pixman_region32_union_rect(&expected_region, &expected_region,
+                                       output_box.x, output_box.y, output_box.width, output_box.height);
+        }
+
+        viv_geometry_layout_region_to_output_region(&output_region, &layout_region, -1920, 0, scale,
+                                                    VIV_GEOMETRY_ROUND_OUTWARD, &scratch);
+        TEST_ASSERT_TRUE(pixman_region32_equal(&output_region, &expected_region));
+
+        pixman_region32_fini(&layout_region);
+        pixman_region32_fini(&output_region);
+        pixman_region32_fini(&expected_region);
+    }
+    viv_geometry_scratch_fini(&scratch);
+}
+
+void test_region_with_overlapping_rounded_bands(void) {
+    // Boxes meeting at y = 5, which is 7.5 at scale 1.5, so that rounding outwards makes
+    // the bands above and below it overlap
+    struct wlr_box layout_boxes[3] = {
+        {.x = 1, .y = 1, .width = 3, .height = 4},
+        {.x = 5, .y = 1, .width = 3, .height = 4},
+        {.x = 3, .y = 5, .width = 9, .height = 3},
+    };
+
+    pixman_region32_t layout_region, output_region, expected_region;
+    pixman_region32_init(&layout_region);
+    pixman_region32_init(&output_region);
+    pixman_region32_init(&expected_region);
+    for (size_t i = 0; i < 3; i++) {
+        struct wlr_box *box = &layout_boxes[i];
+        pixman_region32_union_rect(&layout_region, &layout_region, box->x, box->y, box->width, box->height);
+
+        struct wlr_box output_box;
+        viv_geometry_layout_box_to_output_box(&output_box, box, 0, 0, 1.5, VIV_GEOMETRY_ROUND_OUTWARD);
+        pixman_region32_union_rect(&expected_region, &expected_region,
+                                   output_box.x, output_box.y, output_box.width, output_box.height);
+    }
+
+    struct viv_geometry_scratch scratch = { 0 };
+    viv_geometry_layout_region_to_output_region(&output_region, &layout_region, 0, 0, 1.5,
+                                                VIV_GEOMETRY_ROUND_OUTWARD, &scratch);
+    TEST_ASSERT_TRUE(pixman_region32_equal(&output_region, &expected_region));
+    TEST_ASSERT_TRUE(pixman_region32_selfcheck(&output_region));
+
+    // Converting again reuses the storage from the first time
+    uint32_t allocations = scratch.allocations;
+    pixman_region32_data_t *output_data = output_region.data;
+    viv_geometry_layout_region_to_output_region(&output_region, &layout_region, 0, 0, 1.5,
+                                                VIV_GEOMETRY_ROUND_OUTWARD, &scratch);
+    TEST_ASSERT_TRUE(pixman_region32_equal(&output_region, &expected_region));
+    TEST_ASSERT_EQUAL_UINT32(allocations, scratch.allocations);
+    TEST_ASSERT_EQUAL_PTR(output_data, output_region.data);
+
+    viv_geometry_scratch_fini(&scratch);
+    pixman_region32_fini(&layout_region);
+    pixman_region32_fini(&output_region);
+    pixman_region32_fini(&expected_region);
+}
+
+void test_fit_box_modes(void) {
+    struct wlr_box box;
+
+    // A 4:3 box into a 16:9 box
+    viv_geometry_fit_box(&box, 800, 600, 1920, 1080, VIV_GEOMETRY_FIT_STRETCH);
+    assert_box_equal(0, 0, 1920, 1080, &box);
+
+    viv_geometry_fit_box(&box, 800, 600, 1920, 1080, VIV_GEOMETRY_FIT_FIT);
+    assert_box_equal(240, 0, 1440, 1080, &box);
+
+    viv_geometry_fit_box(&box, 800, 600, 1920, 1080, VIV_GEOMETRY_FIT_FILL);
+    assert_box_equal(0, -180, 1920, 1440, &box);
+
+    viv_geometry_fit_box(&box, 800, 600, 1920, 1080, VIV_GEOMETRY_FIT_CENTER);
+    assert_box_equal(560, 240, 800, 600, &box);
+}
+
+void test_fit_box_larger_than_destination(void) {
+    struct wlr_box box;
+
+    viv_geometry_fit_box(&box, 3840, 2160, 1920, 1080, VIV_GEOMETRY_FIT_FIT);
+    assert_box_equal(0, 0, 1920, 1080, &box);
+
+    viv_geometry_fit_box(&box, 3840, 2160, 1920, 1080, VIV_GEOMETRY_FIT_CENTER);
+    assert_box_equal(-960, -540, 3840, 2160, &box);
+}
+
+int main(int argc, char *argv[]) {
+    UNUSED(argc);
+    UNUSED(argv);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_box_at_scale_1_is_only_translated);
+    RUN_TEST(test_box_at_scale_1_5_rounds_edges);
+    RUN_TEST(test_box_at_scale_1_5_on_offset_output);
+    RUN_TEST(test_box_at_scale_2_is_exact);
+    RUN_TEST(test_damage_box_covers_drawn_box);
+    RUN_TEST(test_adjacent_boxes_stay_adjacent);
+    RUN_TEST(test_region_matches_boxes_at_each_scale);
+    RUN_TEST(test_region_with_overlapping_rounded_bands);
+    RUN_TEST(test_fit_box_modes);
+    RUN_TEST(test_fit_box_larger_than_destination);
+    return UNITY_END();
+}
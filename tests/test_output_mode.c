@@ -0,0 +1,190 @@
+#include <string.h>
+#include <unity.h>
+
+#include "viv_config_support.h"
+#include "viv_output_mode.h"
+
+#define MAX_TEST_MODES 8
+
+static struct wlr_output_mode test_modes[MAX_TEST_MODES];
+static struct wl_list modes;
+
+/// Advertise a mode on the test output, after any already added
+static struct wlr_output_mode *add_mode(int32_t width, int32_t height, int32_t refresh, bool preferred) {
+    for (size_t i = 0; i < MAX_TEST_MODES; i++) {
+        struct wlr_output_mode *mode = &test_modes[i];
+        if (mode->width == 0) {
+            mode->width = width;
+            mode->height = height;
+            mode->refresh = refresh;
+            mode->preferred = preferred;
+            wl_list_insert(modes.prev, &mode->link);
+            return mode;
+        }
+    }
+    TEST_FAIL_MESSAGE("Too many test modes");
+    return NULL;
+}
+
+void setUp() {
+    memset(test_modes, 0, sizeof(test_modes));
+    wl_list_init(&modes);
+}
+
+void tearDown() {
+}
+
+static void assert_custom_mode(int32_t width, int32_t height, int32_t refresh,
+                               struct viv_output_mode_choice *choice) {
+    TEST_ASSERT_NULL(choice->mode);
+    TEST_ASSERT_EQUAL_INT32(width, choice->width);
+    TEST_ASSERT_EQUAL_INT32(height, choice->height);
+    TEST_ASSERT_EQUAL_INT32(refresh, choice->refresh);
+}
+
+void test_parse_mode_strings(void) {
+    struct viv_output_mode_spec spec;
+
+    TEST_ASSERT_TRUE(viv_output_mode_parse("preferred", &spec));
+    TEST_ASSERT_EQUAL(VIV_OUTPUT_MODE_PREFERRED, spec.kind);
+
+    TEST_ASSERT_TRUE(viv_output_mode_parse("highest-refresh", &spec));
+    TEST_ASSERT_EQUAL(VIV_OUTPUT_MODE_HIGHEST_REFRESH, spec.kind);
+
+    TEST_ASSERT_TRUE(viv_output_mode_parse("2560x1440", &spec));
+    TEST_ASSERT_EQUAL(VIV_OUTPUT_MODE_SIZE, spec.kind);
+    TEST_ASSERT_EQUAL_INT32(2560, spec.width);
+    TEST_ASSERT_EQUAL_INT32(1440, spec.height);
+    TEST_ASSERT_EQUAL_INT32(0, spec.refresh);
+
+    TEST_ASSERT_TRUE(viv_output_mode_parse("2560x1440@143.912", &spec));
+    TEST_ASSERT_EQUAL_INT32(143912, spec.refresh);
+}
+
+void test_parse_rejects_invalid_mode_strings(void) {
+    struct viv_output_mode_spec spec;
+
+    TEST_ASSERT_FALSE(viv_output_mode_parse("", &spec));
+    TEST_ASSERT_FALSE(viv_output_mode_parse("fastest", &spec));
+    TEST_ASSERT_FALSE(viv_output_mode_parse("2560", &spec));
+    TEST_ASSERT_FALSE(viv_output_mode_parse("2560x", &spec));
+    TEST_ASSERT_FALSE(viv_output_mode_parse("0x1440", &spec));
+    TEST_ASSERT_FALSE(viv_output_mode_parse("2560x1440@", &spec));
+    TEST_ASSERT_FALSE(viv_output_mode_parse("2560x1440@0", &spec));
+    TEST_ASSERT_FALSE(viv_output_mode_parse("2560x1440@60Hz", &spec));
+    TEST_ASSERT_FALSE(viv_output_mode_parse("2560x1440 ", &spec));
+}
+
+void test_choose_preferred_mode(void) {
+    add_mode(1920, 1080, 60000, false);
+    struct wlr_output_mode *preferred = add_mode(2560, 1440, 59951, true);
+    add_mode(2560, 1440, 143912, false);
+
+    struct viv_output_mode_spec spec = {.kind = VIV_OUTPUT_MODE_PREFERRED};
+    struct viv_output_mode_choice choice;
+    TEST_ASSERT_TRUE(viv_output_mode_choose(&modes, &spec, &choice));
+    TEST_ASSERT_EQUAL_PTR(preferred, choice.mode);
+}
+
+void test_choose_highest_refresh_at_preferred_size(void) {
+    add_mode(1920, 1080, 240000, false);
+    add_mode(2560, 1440, 59951, true);
+    struct wlr_output_mode *fastest = add_mode(2560, 1440, 143912, false);
+    add_mode(2560, 1440, 120000, false);
+
+    struct viv_output_mode_spec spec = {.kind = VIV_OUTPUT_MODE_HIGHEST_REFRESH};
+    struct viv_output_mode_choice choice;
+    TEST_ASSERT_TRUE(viv_output_mode_choose(&modes, &spec, &choice));
+    TEST_ASSERT_EQUAL_PTR(fastest, choice.mode);
+    TEST_ASSERT_EQUAL_INT32(143912, choice.refresh);
+}
+
+void test_choose_nearest_refresh_at_size(void) {
+    add_mode(2560, 1440, 59951, true);
+    struct wlr_output_mode *near_144 = add_mode(2560, 1440, 143912, false);
+    struct wlr_output_mode *near_120 = add_mode(2560, 1440, 119998, false);
+
+    struct viv_output_mode_spec spec;
+    struct viv_output_mode_choice choice;
+
+    TEST_ASSERT_TRUE(viv_output_mode_parse("2560x1440@144", &spec));
+    TEST_ASSERT_TRUE(viv_output_mode_choose(&modes, &spec, &choice));
+    TEST_ASSERT_EQUAL_PTR(near_144, choice.mode);
+
+    TEST_ASSERT_TRUE(viv_output_mode_parse("2560x1440@120", &spec));
+    TEST_ASSERT_TRUE(viv_output_mode_choose(&modes, &spec, &choice));
+    TEST_ASSERT_EQUAL_PTR(near_120, choice.mode);
+
+    TEST_ASSERT_TRUE(viv_output_mode_parse("2560x1440", &spec));
+    TEST_ASSERT_TRUE(viv_output_mode_choose(&modes, &spec, &choice));
+    TEST_ASSERT_EQUAL_PTR(near_144, choice.mode);
+}
+
+void test_choose_custom_mode_when_size_not_advertised(void) {
+    add_mode(1920, 1080, 60000, true);
+
+    struct viv_output_mode_spec spec;
+    struct viv_output_mode_choice choice;
+    TEST_ASSERT_TRUE(viv_output_mode_parse("1280x720@30", &spec));
+    TEST_ASSERT_TRUE(viv_output_mode_choose(&modes, &spec, &choice));
+    assert_custom_mode(1280, 720, 30000, &choice);
+}
+
+void test_choose_without_advertised_modes(void) {
+    // As on the headless backend, which takes any custom mode
+    struct viv_output_mode_spec spec = {.kind = VIV_OUTPUT_MODE_PREFERRED};
+    struct viv_output_mode_choice choice;
+    TEST_ASSERT_FALSE(viv_output_mode_choose(&modes, &spec, &choice));
+
+    spec.kind = VIV_OUTPUT_MODE_HIGHEST_REFRESH;
+    TEST_ASSERT_FALSE(viv_output_mode_choose(&modes, &spec, &choice));
+
+    TEST_ASSERT_TRUE(viv_output_mode_parse("1920x1080@144", &spec));
+    TEST_ASSERT_TRUE(viv_output_mode_choose(&modes, &spec, &choice));
+    assert_custom_mode(1920, 1080, 144000, &choice);
+}
+
+void test_choose_idle_mode(void) {
+    add_mode(2560, 1440, 143912, true);
+    add_mode(2560, 1440, 119998, false);
+    struct wlr_output_mode *slowest = add_mode(2560, 1440, 59951, false);
+    add_mode(1920, 1080, 30000, false);
+
+    struct viv_output_mode_choice choice;
+
+    // The nearest to the idle rate at the same size, even if it's faster than asked for
+    TEST_ASSERT_TRUE(viv_output_mode_choose_idle(&modes, 2560, 1440, 143912, 30000, &choice));
+    TEST_ASSERT_EQUAL_PTR(slowest, choice.mode);
+
+    // Never the current rate or faster
+    TEST_ASSERT_FALSE(viv_output_mode_choose_idle(&modes, 2560, 1440, 59951, 30000, &choice));
+    TEST_ASSERT_TRUE(viv_output_mode_choose_idle(&modes, 2560, 1440, 119998, 144000, &choice));
+    TEST_ASSERT_EQUAL_PTR(slowest, choice.mode);
+
+    TEST_ASSERT_FALSE(viv_output_mode_choose_idle(&modes, 2560, 1440, 143912, 0, &choice));
+}
+
+void test_choose_idle_mode_without_advertised_modes(void) {
+    struct viv_output_mode_choice choice;
+    TEST_ASSERT_TRUE(viv_output_mode_choose_idle(&modes, 1920, 1080, 144000, 30000, &choice));
+    assert_custom_mode(1920, 1080, 30000, &choice);
+
+    TEST_ASSERT_FALSE(viv_output_mode_choose_idle(&modes, 1920, 1080, 30000, 30000, &choice));
+}
+
+int main(int argc, char *argv[]) {
+    UNUSED(argc);
+    UNUSED(argv);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_parse_mode_strings);
+    RUN_TEST(test_parse_rejects_invalid_mode_strings);
+    RUN_TEST(test_choose_preferred_mode);
+    RUN_TEST(test_choose_highest_refresh_at_preferred_size);
+    RUN_TEST(test_choose_nearest_refresh_at_size);
+    RUN_TEST(test_choose_custom_mode_when_size_not_advertised);
+    RUN_TEST(test_choose_without_advertised_modes);
+    RUN_TEST(test_choose_idle_mode);
+    RUN_TEST(test_choose_idle_mode_without_advertised_modes);
+    return UNITY_END();
+}